@@ -0,0 +1,675 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "compress.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+
+#ifdef SETOP_WITH_ZLIB
+	#include <zlib.h>
+#endif
+#ifdef SETOP_WITH_ZSTD
+	#include <zstd.h>
+#endif
+#ifdef SETOP_WITH_LZMA
+	#include <lzma.h>
+#endif
+
+
+/** \brief number of compressed bytes read at once from input */
+#define COMPRESSED_CHUNKSIZE (256 << 10)
+/**
+\brief zstd frames are only decompressed in parallel if their header tells a decompressed size of at most this
+\details Each such frame is decompressed into memory as a whole, all others are decompressed as stream,
+	so that memory usage stays bounded. Frames written by pzstd or by setop itself are far smaller.
+*/
+#define PARALLEL_ZSTD_MAX_FRAME (16 << 20)
+/** \brief number of uncompressed bytes compressed independently as one gzip member or zstd frame */
+#define COMPRESS_BLOCKSIZE (4 << 20)
+
+
+Compression detect_compression(char const* data, std::size_t size)
+{
+	auto starts_with = [data, size](char const* magic, std::size_t magic_size)
+	{
+		return size >= magic_size && std::memcmp(data, magic, magic_size) == 0;
+	};
+	if (starts_with("\x1f\x8b", 2))
+		return Compression::GZIP;
+	if (starts_with("\x28\xb5\x2f\xfd", 4))
+		return Compression::ZSTD;
+	if (starts_with("\xfd" "7zXZ\x00", 6))
+		return Compression::XZ;
+	return Compression::NONE;
+}
+
+bool compression_supported(Compression format)
+{
+	switch (format)
+	{
+	case Compression::NONE:
+		return true;
+	case Compression::GZIP:
+#ifdef SETOP_WITH_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case Compression::ZSTD:
+#ifdef SETOP_WITH_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	case Compression::XZ:
+#ifdef SETOP_WITH_LZMA
+		return true;
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
+
+char const* compression_name(Compression format)
+{
+	switch (format)
+	{
+	case Compression::GZIP:
+		return "gzip";
+	case Compression::ZSTD:
+		return "zstd";
+	case Compression::XZ:
+		return "xz";
+	default:
+		return "none";
+	}
+}
+
+
+Compression compression_from_name(std::string const& name)
+{
+	for (Compression format : { Compression::GZIP, Compression::ZSTD, Compression::XZ })
+		if (name == compression_name(format))
+			return format;
+	if (name == "none")
+		return Compression::NONE;
+	throw std::invalid_argument("Compression format \"" + name + "\" is unknown.");
+}
+
+
+/** \brief Puts back some bytes already read from beginning of another source */
+class PrefixedSource : public InputSource
+{
+public:
+	PrefixedSource(std::string prefix, std::unique_ptr<InputSource> source) : prefix(std::move(prefix)), prefix_pos(0), source(std::move(source)) {}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		std::size_t const n = std::min(size, prefix.size() - prefix_pos);
+		std::memcpy(dest, prefix.data() + prefix_pos, n);
+		prefix_pos += n;
+		return (n < size ? n + source->read(dest + n, size - n) : n);
+	}
+
+private:
+	std::string const prefix;
+	std::size_t prefix_pos;
+	std::unique_ptr<InputSource> source;
+};
+
+
+/** \brief Common part of all decompressors: reading compressed data in chunks */
+class DecompressingSource : public InputSource
+{
+protected:
+	DecompressingSource(std::unique_ptr<InputSource> source, std::string const& name, char const* format) :
+		source(std::move(source)), name(name), format(format), chunk(COMPRESSED_CHUNKSIZE), chunk_size(0), input_at_end(false) {}
+
+	/** \brief Reads next compressed chunk, chunk_size is 0 at end of input. */
+	void read_chunk()
+	{
+		chunk_size = source->read(chunk.data(), chunk.size());
+		input_at_end = (chunk_size < chunk.size());
+	}
+
+	[[noreturn]] void fail(std::string const& reason) const
+	{
+		throw std::runtime_error("Input " + name + " could not be decompressed (" + format + "): " + reason);
+	}
+
+	std::unique_ptr<InputSource> source;
+	std::string const name;
+	char const* const format;
+	std::vector<char> chunk; ///< compressed data
+	std::size_t chunk_size; ///< number of bytes in chunk
+	bool input_at_end;
+};
+
+
+#ifdef SETOP_WITH_ZLIB
+
+/** \brief Decompresses gzip input, also several concatenated gzip members (like gzip -d does) */
+class GzipSource : public DecompressingSource
+{
+public:
+	GzipSource(std::unique_ptr<InputSource> source, std::string const& name) :
+		DecompressingSource(std::move(source), name, "gzip"), at_end(false)
+	{
+		std::memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, 15 + 16) != Z_OK) // 15 + 16: maximal window size and gzip header
+			throw std::bad_alloc();
+	}
+
+	~GzipSource() override
+	{
+		inflateEnd(&stream);
+	}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		stream.next_out = reinterpret_cast<Bytef*>(dest);
+		stream.avail_out = static_cast<uInt>(size);
+		while (stream.avail_out > 0 && !at_end)
+		{
+			if (stream.avail_in == 0)
+			{
+				if (input_at_end)
+					fail("unexpected end of input");
+				read_chunk();
+				stream.next_in = reinterpret_cast<Bytef*>(chunk.data());
+				stream.avail_in = static_cast<uInt>(chunk_size);
+				if (chunk_size == 0)
+					fail("unexpected end of input");
+			}
+			int const result = inflate(&stream, Z_NO_FLUSH);
+			if (result == Z_STREAM_END)
+			{
+				// another member may follow
+				if (skip_padding())
+					at_end = true;
+				else
+					inflateReset(&stream);
+			}
+			else if (result != Z_OK && result != Z_BUF_ERROR)
+			{
+				fail(stream.msg ? stream.msg : "corrupt data");
+			}
+		}
+		return size - stream.avail_out;
+	}
+
+private:
+	/** \brief Skips zero bytes behind a member (padding, e. g. from tape archives, ignored by gzip -d, too), returns if input is at end. */
+	bool skip_padding()
+	{
+		while (true)
+		{
+			while (stream.avail_in > 0 && *stream.next_in == 0)
+			{
+				++stream.next_in;
+				--stream.avail_in;
+			}
+			if (stream.avail_in > 0)
+				return false;
+			if (input_at_end)
+				return true;
+			read_chunk();
+			stream.next_in = reinterpret_cast<Bytef*>(chunk.data());
+			stream.avail_in = static_cast<uInt>(chunk_size);
+		}
+	}
+
+	z_stream stream;
+	bool at_end;
+};
+
+#endif // SETOP_WITH_ZLIB
+
+
+#ifdef SETOP_WITH_LZMA
+
+/** \brief Decompresses xz input, also several concatenated xz streams */
+class XzSource : public DecompressingSource
+{
+public:
+	XzSource(std::unique_ptr<InputSource> source, std::string const& name) :
+		DecompressingSource(std::move(source), name, "xz"), stream(LZMA_STREAM_INIT), at_end(false)
+	{
+		if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+			throw std::bad_alloc();
+	}
+
+	~XzSource() override
+	{
+		lzma_end(&stream);
+	}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		stream.next_out = reinterpret_cast<uint8_t*>(dest);
+		stream.avail_out = size;
+		while (stream.avail_out > 0 && !at_end)
+		{
+			if (stream.avail_in == 0 && !input_at_end)
+			{
+				read_chunk();
+				stream.next_in = reinterpret_cast<uint8_t const*>(chunk.data());
+				stream.avail_in = chunk_size;
+			}
+			lzma_ret const result = lzma_code(&stream, input_at_end ? LZMA_FINISH : LZMA_RUN);
+			if (result == LZMA_STREAM_END)
+				at_end = true;
+			else if (result == LZMA_BUF_ERROR)
+				fail("unexpected end of input");
+			else if (result != LZMA_OK)
+				fail(result == LZMA_MEM_ERROR ? "out of memory" : "corrupt data");
+		}
+		return size - stream.avail_out;
+	}
+
+private:
+	lzma_stream stream;
+	bool at_end;
+};
+
+#endif // SETOP_WITH_LZMA
+
+
+#ifdef SETOP_WITH_ZSTD
+
+/** \brief Decompresses zstd input as one stream (with any number of frames) */
+class ZstdSource : public DecompressingSource
+{
+public:
+	ZstdSource(std::unique_ptr<InputSource> source, std::string const& name) :
+		DecompressingSource(std::move(source), name, "zstd"), stream(ZSTD_createDStream()), input{ nullptr, 0, 0 }, frame_complete(true)
+	{
+		if (!stream)
+			throw std::bad_alloc();
+		ZSTD_initDStream(stream);
+	}
+
+	~ZstdSource() override
+	{
+		ZSTD_freeDStream(stream);
+	}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		ZSTD_outBuffer output = { dest, size, 0 };
+		while (output.pos < output.size)
+		{
+			if (input.pos == input.size)
+			{
+				if (input_at_end)
+				{
+					// decoder may still hold decompressed data
+					std::size_t const pos_before = output.pos;
+					decompress(output);
+					if (output.pos == pos_before)
+						break;
+					continue;
+				}
+				read_chunk();
+				input = { chunk.data(), chunk_size, 0 };
+			}
+			decompress(output);
+		}
+		if (output.pos < output.size && !frame_complete)
+			fail("unexpected end of input");
+		return output.pos;
+	}
+
+private:
+	void decompress(ZSTD_outBuffer& output)
+	{
+		std::size_t const input_before = input.pos, output_before = output.pos;
+		std::size_t const result = ZSTD_decompressStream(stream, &output, &input);
+		if (ZSTD_isError(result))
+			fail(ZSTD_getErrorName(result));
+		if (input.pos != input_before || output.pos != output_before)
+			frame_complete = (result == 0);
+	}
+
+	ZSTD_DStream* stream;
+	ZSTD_inBuffer input;
+	bool frame_complete; ///< last call of decompress finished a frame
+};
+
+
+/**
+\brief Decompresses zstd input consisting of several independent frames in parallel
+\details Input written by pzstd (or by any tool appending frames) has many frames, each can be decompressed on its own.
+	Frames are cut from compressed input and decompressed in separate threads; results are handed out in order.
+	As soon as a frame has no known decompressed size of at most PARALLEL_ZSTD_MAX_FRAME (like the single frame
+	written by zstd for a large file or a pipe), or input is a single frame, the rest of input is decompressed as stream.
+*/
+class ParallelZstdSource : public DecompressingSource
+{
+public:
+	ParallelZstdSource(std::unique_ptr<InputSource> source, std::string const& name, unsigned threads) :
+		DecompressingSource(std::move(source), name, "zstd"), max_frames_in_flight(2 * threads), pending_pos(0), started(0), curr_pos(0) {}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		std::size_t copied = 0;
+		while (copied < size)
+		{
+			if (streaming)
+				return copied + streaming->read(dest + copied, size - copied);
+			if (curr_pos == curr_frame.size())
+			{
+				start_frames();
+				if (frames.empty())
+				{
+					if (streaming)
+						continue;
+					break;
+				}
+				curr_frame = frames.front().get();
+				frames.pop_front();
+				curr_pos = 0;
+				continue;
+			}
+			std::size_t const n = std::min(size - copied, curr_frame.size() - curr_pos);
+			std::memcpy(dest + copied, curr_frame.data() + curr_pos, n);
+			copied += n;
+			curr_pos += n;
+		}
+		return copied;
+	}
+
+private:
+	/** \brief Cuts complete frames from compressed input and starts decompressing them, until enough frames are in flight. */
+	void start_frames()
+	{
+		while (frames.size() < max_frames_in_flight && !streaming)
+		{
+			char const* const frame = pending.data() + pending_pos;
+			std::size_t const available = pending.size() - pending_pos;
+			if (available == 0 && input_at_end)
+				break;
+			// an error means that the frame header is not complete yet (or invalid, which the stream decompressor reports)
+			unsigned long long const content_size = ZSTD_getFrameContentSize(frame, available);
+			std::size_t const frame_size = ZSTD_findFrameCompressedSize(frame, available);
+			bool const complete = !ZSTD_isError(frame_size);
+			bool const single = (started == 0 && complete && frame_size == available);
+			if ((content_size != ZSTD_CONTENTSIZE_ERROR && (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size > PARALLEL_ZSTD_MAX_FRAME)) ||
+				(single && input_at_end) || (!complete && (input_at_end || available > ZSTD_compressBound(PARALLEL_ZSTD_MAX_FRAME))))
+			{
+				// continue (after frames in flight) with stream decompression
+				if (frames.empty())
+					streaming.reset(new ZstdSource(std::unique_ptr<InputSource>(new PrefixedSource(pending.substr(pending_pos), std::move(source))), name));
+				break;
+			}
+			if (complete && !single)
+			{
+				frames.push_back(std::async(std::launch::async, &ParallelZstdSource::decompress_frame, pending.substr(pending_pos, frame_size), name));
+				pending_pos += frame_size;
+				++started;
+				continue;
+			}
+			// frame not complete yet, or not known to be followed by another one: drop consumed part of pending and read more
+			pending.erase(0, pending_pos);
+			pending_pos = 0;
+			read_chunk();
+			pending.append(chunk.data(), chunk_size);
+		}
+	}
+
+	static std::string decompress_frame(std::string const& frame, std::string const& name)
+	{
+		std::string result;
+		std::unique_ptr<ZSTD_DStream, std::size_t(*)(ZSTD_DStream*)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+		if (!stream)
+			throw std::bad_alloc();
+		ZSTD_initDStream(stream.get());
+		unsigned long long const content_size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+		if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR)
+			result.reserve(content_size);
+		ZSTD_inBuffer input = { frame.data(), frame.size(), 0 };
+		std::vector<char> output_buffer(ZSTD_DStreamOutSize());
+		std::size_t remaining;
+		do
+		{
+			ZSTD_outBuffer output = { output_buffer.data(), output_buffer.size(), 0 };
+			remaining = ZSTD_decompressStream(stream.get(), &output, &input);
+			if (ZSTD_isError(remaining))
+				throw std::runtime_error("Input " + name + " could not be decompressed (zstd): " + ZSTD_getErrorName(remaining));
+			result.append(output_buffer.data(), output.pos);
+		} while (remaining != 0);
+		return result;
+	}
+
+	std::size_t const max_frames_in_flight;
+	std::string pending; ///< compressed data not yet cut into frames
+	std::size_t pending_pos; ///< begin of next frame in pending
+	std::size_t started; ///< number of frames decompressed in parallel so far
+	std::deque<std::future<std::string>> frames; ///< frames being decompressed, in order of input (destructors wait for threads)
+	std::string curr_frame; ///< decompressed frame currently consumed by read
+	std::size_t curr_pos; ///< first byte in curr_frame not consumed yet
+	std::unique_ptr<InputSource> streaming; ///< used when frames are too large
+};
+
+#endif // SETOP_WITH_ZSTD
+
+
+std::unique_ptr<InputSource> open_decompressed(std::unique_ptr<InputSource> source, std::string const& name,
+	unsigned threads, bool& decompressing)
+{
+	// all magic numbers fit into 6 bytes
+	char magic[6];
+	std::size_t const magic_size = source->read(magic, sizeof(magic));
+	Compression const format = detect_compression(magic, magic_size);
+	source.reset(new PrefixedSource(std::string(magic, magic_size), std::move(source)));
+
+	// magic bytes can also be the begin of a text, so input in a format not supported by this build is read as it is
+	if (!compression_supported(format))
+	{
+		std::cerr << "Warning: Input " << name << " looks compressed with " << compression_name(format) <<
+			", but this build of setop does not support this format. Reading it uncompressed.\n";
+		decompressing = false;
+		return source;
+	}
+	decompressing = (format != Compression::NONE);
+
+	switch (format)
+	{
+#ifdef SETOP_WITH_ZLIB
+	case Compression::GZIP:
+		return std::unique_ptr<InputSource>(new GzipSource(std::move(source), name));
+#endif
+#ifdef SETOP_WITH_ZSTD
+	case Compression::ZSTD:
+		if (threads > 1)
+			return std::unique_ptr<InputSource>(new ParallelZstdSource(std::move(source), name, threads));
+		return std::unique_ptr<InputSource>(new ZstdSource(std::move(source), name));
+#endif
+#ifdef SETOP_WITH_LZMA
+	case Compression::XZ:
+		return std::unique_ptr<InputSource>(new XzSource(std::move(source), name));
+#endif
+	default:
+		(void)threads;
+		return source;
+	}
+}
+
+
+/** \brief Compresses blocks of output in parallel and writes them in order */
+class CompressingSink : public OutputSink
+{
+public:
+	CompressingSink(std::unique_ptr<OutputSink> sink, Compression format, int level, unsigned threads) :
+		sink(std::move(sink)), format(format), level(level), threads(threads), written_any(false)
+	{
+		pending.reserve(COMPRESS_BLOCKSIZE);
+	}
+
+	void write(OutputBlock const* blocks, std::size_t count) override
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			char const* data = blocks[i].data;
+			std::size_t size = blocks[i].size;
+			while (size > 0)
+			{
+				std::size_t const n = std::min(size, COMPRESS_BLOCKSIZE - pending.size());
+				pending.insert(pending.end(), data, data + n);
+				data += n;
+				size -= n;
+				if (pending.size() == COMPRESS_BLOCKSIZE)
+					compress_pending();
+			}
+		}
+	}
+
+	void finish() override
+	{
+		// an empty file is no valid gzip file, so write at least one (empty) block
+		if (!pending.empty() || !written_any)
+			compress_pending();
+		while (!compressed.empty())
+			write_first();
+		sink->finish();
+	}
+
+private:
+	void compress_pending()
+	{
+		written_any = true;
+		if (threads <= 1)
+		{
+			sink->write_buffer(compress_block(pending, format, level));
+		}
+		else
+		{
+			// at most threads blocks are compressed at once
+			while (compressed.size() >= threads)
+				write_first();
+			compressed.push_back(std::async(std::launch::async, &CompressingSink::compress_block, std::move(pending), format, level));
+		}
+		pending = OutputBuffer();
+		pending.reserve(COMPRESS_BLOCKSIZE);
+	}
+
+	void write_first()
+	{
+		sink->write_buffer(compressed.front().get());
+		compressed.pop_front();
+	}
+
+	static OutputBuffer compress_block(OutputBuffer const& block, Compression format, int level)
+	{
+		OutputBuffer result;
+		switch (format)
+		{
+#ifdef SETOP_WITH_ZLIB
+		case Compression::GZIP:
+		{
+			z_stream stream;
+			std::memset(&stream, 0, sizeof(stream));
+			if (deflateInit2(&stream, level == COMPRESSION_LEVEL_DEFAULT ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw std::runtime_error("Compressing output (gzip) failed: invalid compression level.");
+			result.resize(deflateBound(&stream, block.size()));
+			stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.data()));
+			stream.avail_in = static_cast<uInt>(block.size());
+			stream.next_out = reinterpret_cast<Bytef*>(result.data());
+			stream.avail_out = static_cast<uInt>(result.size());
+			int const status = deflate(&stream, Z_FINISH);
+			deflateEnd(&stream);
+			if (status != Z_STREAM_END)
+				throw std::runtime_error("Compressing output (gzip) failed.");
+			result.resize(result.size() - stream.avail_out);
+			break;
+		}
+#endif
+#ifdef SETOP_WITH_ZSTD
+		case Compression::ZSTD:
+		{
+			result.resize(ZSTD_compressBound(block.size()));
+			std::size_t const size = ZSTD_compress(result.data(), result.size(), block.data(), block.size(),
+				level == COMPRESSION_LEVEL_DEFAULT ? ZSTD_CLEVEL_DEFAULT : level);
+			if (ZSTD_isError(size))
+				throw std::runtime_error(std::string("Compressing output (zstd) failed: ") + ZSTD_getErrorName(size));
+			result.resize(size);
+			break;
+		}
+#endif
+		default:
+			(void)block; (void)level;
+			throw std::runtime_error(std::string("Compressing output with ") + compression_name(format) + " is not supported.");
+		}
+		return result;
+	}
+
+	std::unique_ptr<OutputSink> sink;
+	Compression const format;
+	int const level;
+	unsigned const threads;
+	OutputBuffer pending; ///< uncompressed data not yet forming a whole block
+	std::deque<std::future<OutputBuffer>> compressed; ///< blocks being compressed, in order of output
+	bool written_any;
+};
+
+
+void check_output_compression(Compression format, int level)
+{
+	if (format == Compression::NONE)
+		return;
+	if (format == Compression::XZ || !compression_supported(format))
+		throw std::invalid_argument(std::string("Compressing output with ") + compression_name(format) + " is not supported by this build of setop.");
+
+	if (level == COMPRESSION_LEVEL_DEFAULT)
+		return;
+	int min_level = 0, max_level = 0;
+#ifdef SETOP_WITH_ZLIB
+	if (format == Compression::GZIP)
+		max_level = Z_BEST_COMPRESSION;
+#endif
+#ifdef SETOP_WITH_ZSTD
+	if (format == Compression::ZSTD)
+	{
+		// negative levels are faster modes
+	#if ZSTD_VERSION_NUMBER >= 10400
+		min_level = ZSTD_minCLevel();
+	#else
+		min_level = 1;
+	#endif
+		max_level = ZSTD_maxCLevel();
+	}
+#endif
+	if (level < min_level || level > max_level)
+		throw std::invalid_argument(std::string("Compression level for ") + compression_name(format) + " must be between " +
+			std::to_string(min_level) + " and " + std::to_string(max_level) + ".");
+}
+
+
+std::unique_ptr<OutputSink> open_compressed_output(std::unique_ptr<OutputSink> sink, Compression format, int level, unsigned threads)
+{
+	if (format == Compression::NONE)
+		return sink;
+	if (format == Compression::XZ || !compression_supported(format))
+		throw std::runtime_error(std::string("Compressing output with ") + compression_name(format) + " is not supported by this build of setop.");
+	return std::unique_ptr<OutputSink>(new CompressingSink(std::move(sink), format, level, threads));
+}
@@ -0,0 +1,91 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_COMPRESS_HPP
+#define SETOP_COMPRESS_HPP
+
+#include <climits>
+#include <cstddef>
+#include <memory>
+
+#include "input.hpp"
+#include "output.hpp"
+
+
+/**
+\file
+\brief Support for compressed inputs (gzip, zstd, xz) and outputs (gzip, zstd)
+\details Each format is only available when setop is built with the corresponding library,
+	see macros SETOP_WITH_ZLIB, SETOP_WITH_ZSTD, and SETOP_WITH_LZMA (set by Makefile).
+*/
+
+
+/** \brief compression level standing for the default level of a format (zstd also has negative levels) */
+#define COMPRESSION_LEVEL_DEFAULT INT_MIN
+
+/** \brief all compression formats known to setop */
+enum class Compression : unsigned char { NONE, GZIP, ZSTD, XZ };
+
+/**
+\brief Recognizes compression format by magic bytes at beginning of data.
+\param data first bytes of input
+\param size number of bytes in data, 6 are enough for all formats
+*/
+Compression detect_compression(char const* data, std::size_t size);
+
+/** \brief Returns if setop is built with support for given format. */
+bool compression_supported(Compression format);
+
+/** \brief Returns name of format like "gzip". */
+char const* compression_name(Compression format);
+
+/**
+\brief Decompresses source on the fly if it starts with magic bytes of a supported compression format.
+\details If the format is recognized, but not supported by this build, a warning is printed and source is read uncompressed.
+\param source input, taken over
+\param name name of input for error messages
+\param threads number of threads that may be used for decompressing independent parts (zstd frames) in parallel
+\param[out] decompressing set to true if source is compressed
+\return source itself (with first bytes put back) or decompressing source
+*/
+std::unique_ptr<InputSource> open_decompressed(std::unique_ptr<InputSource> source, std::string const& name,
+	unsigned threads, bool& decompressing);
+
+/**
+\brief Recognizes compression format by name like "gzip".
+\throws std::invalid_argument
+*/
+Compression compression_from_name(std::string const& name);
+
+/**
+\brief Checks if output can be compressed with format and level by this build.
+\details Levels are 0 to 9 for gzip, and ZSTD_minCLevel() (negative, faster) to ZSTD_maxCLevel() for zstd.
+\param level compression level, COMPRESSION_LEVEL_DEFAULT for default level of format
+\throws std::invalid_argument
+*/
+void check_output_compression(Compression format, int level);
+
+/**
+\brief Compresses everything written to sink.
+\details Output is cut into blocks of some MB, each compressed independently (as gzip member or zstd frame) in parallel.
+	Concatenated members or frames are valid gzip or zstd data and are decompressed by the usual tools (and by setop in parallel).
+\param sink destination of compressed data, taken over
+\param format GZIP or ZSTD
+\param level compression level, COMPRESSION_LEVEL_DEFAULT for default level of format
+\param threads maximal number of blocks compressed at once
+\throws std::runtime_error if format is not supported by this build
+*/
+std::unique_ptr<OutputSink> open_compressed_output(std::unique_ptr<OutputSink> sink, Compression format, int level, unsigned threads);
+
+#endif // SETOP_COMPRESS_HPP
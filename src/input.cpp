@@ -0,0 +1,723 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "input.hpp"
+#include "compress.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define SETOP_HAVE_POSIX
+	#include <sys/stat.h>
+	#include <sys/resource.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#define SETOP_HAVE_IO_URING
+	#endif
+#endif
+
+#ifdef SETOP_HAVE_IO_URING
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <sys/uio.h>
+#endif
+
+
+/**
+\brief number of bytes the reader thread of a pipelined input reads at once
+\details large enough that switching between threads is rare, small enough that some chunks fit into the CPU caches
+*/
+#define PIPELINE_CHUNKSIZE (1 << 20)
+/** \brief size of buffer of std::ifstream, so that big files are read with few system calls */
+#define STREAM_BUFFERSIZE (1 << 20)
+/** \brief number of bytes read with one io_uring request */
+#define URING_BLOCKSIZE (256 << 10)
+/** \brief number of io_uring requests in flight per input file */
+#define URING_QUEUE_DEPTH 16
+/** \brief number of bytes read at once when reading directly from file descriptor, e. g. bypassing the page cache */
+#define DESCRIPTOR_BUFFERSIZE (4 << 20)
+/** \brief alignment of buffers and reads for O_DIRECT, sufficient for all common devices */
+#define DIRECT_IO_ALIGNMENT 4096
+/** \brief desired capacity of pipe at standard input, default of Linux (64 KB) causes too many context switches */
+#define STDIN_PIPESIZE (1 << 20)
+
+
+StreamSource::StreamSource() : inputstream(std::cin)
+{
+}
+
+StreamSource::StreamSource(std::string const& filename) : inputstream(inputfile)
+{
+	// default buffer of std::filebuf is small (some KB), so reading would be done in tiny pieces
+	buffer.reset(new char[STREAM_BUFFERSIZE]);
+	inputfile.rdbuf()->pubsetbuf(buffer.get(), STREAM_BUFFERSIZE);
+	inputfile.open(filename);
+	if (!inputfile)
+		throw std::runtime_error("Input file " + filename + " could not be opened.");
+}
+
+std::size_t StreamSource::read(char* dest, std::size_t size)
+{
+	inputstream.read(dest, size);
+	return inputstream.gcount();
+}
+
+
+PipelinedSource::PipelinedSource(std::unique_ptr<InputSource> source, std::size_t chunksize, std::size_t chunks) :
+	source(std::move(source)), chunksize(chunksize), filled_chunks(chunks), free_chunks(chunks + 2), curr_pos(0), at_end(false)
+{
+	reader = std::thread(&PipelinedSource::run_reader, this);
+}
+
+PipelinedSource::~PipelinedSource()
+{
+	// wake up reader thread if it waits for free chunks, e. g. because parsing was aborted
+	free_chunks.close();
+	filled_chunks.close();
+	reader.join();
+}
+
+void PipelinedSource::run_reader()
+{
+	try
+	{
+		chunk_t chunk;
+		do
+		{
+			if (!free_chunks.try_pop(chunk) || chunk.capacity() < chunksize)
+				chunk = chunk_t(chunksize);
+			chunk.resize(chunksize);
+			chunk.resize(source->read(chunk.data(), chunksize));
+		} while (chunk.size() == chunksize && filled_chunks.push(std::move(chunk)));
+		// last chunk is always short (maybe empty), this marks end of input for read
+		filled_chunks.push(std::move(chunk));
+	}
+	catch (...)
+	{
+		reader_error.store_current();
+	}
+	filled_chunks.close();
+}
+
+std::size_t PipelinedSource::read(char* dest, std::size_t size)
+{
+	std::size_t copied = 0;
+	while (copied < size)
+	{
+		if (curr_pos == curr_chunk.size())
+		{
+			if (at_end)
+				break;
+			free_chunks.push(std::move(curr_chunk));
+			curr_chunk.clear();
+			curr_pos = 0;
+			if (!filled_chunks.pop(curr_chunk))
+			{
+				// queue is only closed without short chunk when reader failed
+				reader_error.rethrow();
+				throw std::runtime_error("Reading input was aborted.");
+			}
+			// only the last chunk is short
+			at_end = (curr_chunk.size() < chunksize);
+			continue;
+		}
+		std::size_t const n = std::min(size - copied, curr_chunk.size() - curr_pos);
+		std::memcpy(dest + copied, curr_chunk.data() + curr_pos, n);
+		copied += n;
+		curr_pos += n;
+	}
+	return copied;
+}
+
+
+#ifdef SETOP_HAVE_POSIX
+
+/**
+\brief Opens file for reading, if desired without using the page cache.
+\param[in,out] direct use O_DIRECT; set to false if file system does not support it
+\throws std::runtime_error
+*/
+static int open_file_descriptor(std::string const& filename, bool& direct)
+{
+	int fd = -1;
+#ifdef O_DIRECT
+	if (direct)
+	{
+		fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+		if (fd < 0 && errno != EINVAL) // EINVAL: file system does not support O_DIRECT (e. g. tmpfs)
+			throw std::runtime_error("Input file " + filename + " could not be opened.");
+	}
+#endif
+	if (fd < 0)
+	{
+		direct = false;
+		fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw std::runtime_error("Input file " + filename + " could not be opened.");
+	}
+	return fd;
+}
+
+/**
+\brief Tells kernel that given part of file will not be needed again, so that it is not kept in page cache.
+\details Only a hint, silently ignored if not supported.
+*/
+static void drop_from_page_cache(int fd, off_t offset, off_t length)
+{
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+#else
+	(void)fd; (void)offset; (void)length;
+#endif
+}
+
+
+/**
+\brief Input read with plain POSIX read in large pieces, optionally bypassing the page cache
+\details With O_DIRECT all reads go to an aligned buffer with aligned sizes, data is not cached by the kernel at all.
+	Where O_DIRECT is not available, pages that have been read are dropped from the page cache immediately instead.
+	Both keep one-off scans of huge files from evicting the page cache of other processes.
+*/
+class DescriptorSource : public InputSource
+{
+public:
+	/**
+	\param fd file descriptor to read from
+	\param name name of input for error messages
+	\param owns_fd fd is closed by destructor
+	\param direct fd is opened with O_DIRECT
+	\param drop_cache drop pages from page cache after reading them
+	*/
+	DescriptorSource(int fd, std::string const& name, bool owns_fd, bool direct, bool drop_cache);
+	~DescriptorSource() override;
+
+	std::size_t read(char* dest, std::size_t size) override;
+
+private:
+	void fill_buffer();
+
+	int const fd;
+	std::string const name;
+	bool const owns_fd;
+	bool direct, drop_cache;
+	char* buffer; ///< aligned for O_DIRECT
+	std::size_t buffer_begin, buffer_end; ///< part of buffer that has not been consumed yet
+	off_t offset; ///< position in file of buffer_end
+	bool at_end;
+};
+
+DescriptorSource::DescriptorSource(int fd, std::string const& name, bool owns_fd, bool direct, bool drop_cache) :
+	fd(fd), name(name), owns_fd(owns_fd), direct(direct), drop_cache(drop_cache), buffer(nullptr), buffer_begin(0), buffer_end(0), offset(0), at_end(false)
+{
+	void* memory = nullptr;
+	if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, DESCRIPTOR_BUFFERSIZE) != 0)
+	{
+		if (owns_fd)
+			close(fd);
+		throw std::bad_alloc();
+	}
+	buffer = static_cast<char*>(memory);
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+DescriptorSource::~DescriptorSource()
+{
+	std::free(buffer);
+	if (owns_fd)
+		close(fd);
+}
+
+void DescriptorSource::fill_buffer()
+{
+	ssize_t bytes_read;
+	while (true)
+	{
+		bytes_read = ::read(fd, buffer, DESCRIPTOR_BUFFERSIZE);
+		if (bytes_read >= 0)
+			break;
+		if (errno == EINTR)
+			continue;
+#ifdef O_DIRECT
+		// some file systems accept O_DIRECT on open, but not on read; also after a short read offset is not aligned anymore
+		if (errno == EINVAL && direct)
+		{
+			direct = false;
+			drop_cache = true;
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			continue;
+		}
+#endif
+		throw std::runtime_error("Input " + name + " could not be read: " + std::strerror(errno));
+	}
+
+	if (drop_cache && bytes_read > 0)
+		drop_from_page_cache(fd, offset, bytes_read);
+	offset += bytes_read;
+	buffer_begin = 0;
+	buffer_end = bytes_read;
+	at_end = (bytes_read == 0);
+}
+
+std::size_t DescriptorSource::read(char* dest, std::size_t size)
+{
+	std::size_t copied = 0;
+	while (copied < size)
+	{
+		if (buffer_begin == buffer_end)
+		{
+			if (at_end)
+				break;
+			fill_buffer();
+			continue;
+		}
+		std::size_t const n = std::min(size - copied, buffer_end - buffer_begin);
+		std::memcpy(dest + copied, buffer + buffer_begin, n);
+		copied += n;
+		buffer_begin += n;
+	}
+	return copied;
+}
+
+
+/**
+\brief Opens standard input for reading with plain POSIX read.
+\details std::cin is slow (synchronized with C stdio, small buffer), and most of the time standard input is a pipe
+	from a decompressor or similar. Such a pipe is enlarged, so that the writing process can work ahead and both processes
+	switch less often.
+*/
+static std::unique_ptr<InputSource> open_standard_input()
+{
+	struct stat stdin_stat;
+	if (fstat(STDIN_FILENO, &stdin_stat) != 0)
+		return nullptr;
+#ifdef F_SETPIPE_SZ
+	// only a hint, fails e. g. when desired size exceeds /proc/sys/fs/pipe-max-size for unprivileged users
+	if (S_ISFIFO(stdin_stat.st_mode) && fcntl(STDIN_FILENO, F_GETPIPE_SZ) < STDIN_PIPESIZE)
+		fcntl(STDIN_FILENO, F_SETPIPE_SZ, STDIN_PIPESIZE);
+#endif
+	return std::unique_ptr<InputSource>(new DescriptorSource(STDIN_FILENO, "standard input", false, false, false));
+}
+
+#endif // SETOP_HAVE_POSIX
+
+
+#ifdef SETOP_HAVE_IO_URING
+
+/**
+\brief Input from a regular file read asynchronously by Linux’ io_uring
+\details Keeps many large reads in flight into buffers registered with the kernel,
+	so that fast devices (NVMe) are used at a reasonable queue depth. Completed blocks are handed out in file order.
+*/
+class UringSource : public InputSource
+{
+public:
+	/**
+	\brief Opens file and sets up ring.
+	\details Object is not usable when ready() returns false afterwards (no io_uring support or no regular file).
+	\throws std::runtime_error if file could not be opened
+	*/
+	UringSource(std::string const& filename, bool direct);
+	~UringSource() override;
+
+	bool ready() const { return ring_fd >= 0; }
+	std::size_t read(char* dest, std::size_t size) override;
+
+private:
+	/** \brief one read request and its buffer */
+	struct Slot
+	{
+		char* buffer;
+		off_t offset; ///< position in file
+		std::size_t length; ///< number of bytes requested
+		std::size_t filled; ///< number of bytes read so far
+		bool in_flight; ///< request submitted, but not completed yet
+		bool used; ///< slot holds a block of the file (in flight or completed)
+		bool direct; ///< request was submitted while file was read with O_DIRECT
+	};
+
+	void setup_ring();
+	void submit(std::size_t slot_index);
+	void wait_for_completions();
+
+	std::string const filename;
+	int file_fd;
+	bool direct; ///< file is opened with O_DIRECT
+	bool drop_cache; ///< O_DIRECT was desired, but is not supported
+	off_t file_size;
+	int ring_fd;
+
+	// rings shared with kernel
+	void* sq_ring;
+	void* cq_ring;
+	std::size_t sq_ring_size, cq_ring_size;
+	io_uring_sqe* sqes;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	io_uring_cqe* cqes;
+	std::size_t sqes_count;
+
+	char* buffers; ///< memory for all slots, registered with kernel
+	std::vector<Slot> slots;
+	std::size_t in_flight; ///< number of submitted, uncompleted requests
+	off_t next_offset; ///< position in file for next request
+	std::size_t curr_slot; ///< slot currently consumed by read (blocks are handed out in file order)
+	std::size_t curr_pos; ///< first byte in curr_slot not consumed yet
+};
+
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* params)
+{
+	return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+	return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+
+UringSource::UringSource(std::string const& filename, bool direct) :
+	filename(filename), file_fd(-1), direct(direct), drop_cache(false), file_size(0), ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED),
+	sq_ring_size(0), cq_ring_size(0), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqes_count(0), buffers(nullptr),
+	in_flight(0), next_offset(0), curr_slot(0), curr_pos(0)
+{
+	// offsets and buffers of all requests are aligned, so O_DIRECT needs no special handling (except for short reads, see submit)
+	file_fd = open_file_descriptor(filename, this->direct);
+	drop_cache = (direct && !this->direct);
+	struct stat file_stat;
+	if (fstat(file_fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+		return;
+	file_size = file_stat.st_size;
+	setup_ring();
+	if (!ready())
+		return;
+
+	// issue first requests right away, so that device is busy while caller prepares parsing
+	for (std::size_t i = 0; i < slots.size() && next_offset < file_size; ++i)
+	{
+		slots[i].offset = next_offset;
+		slots[i].length = URING_BLOCKSIZE;
+		next_offset += URING_BLOCKSIZE;
+		submit(i);
+	}
+}
+
+void UringSource::setup_ring()
+{
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	int fd = sys_io_uring_setup(URING_QUEUE_DEPTH, &params);
+	if (fd < 0)
+		return;
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+	if (single_mmap)
+		sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+	sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ring != MAP_FAILED)
+		cq_ring = (single_mmap ? sq_ring :
+			mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING));
+	sqes_count = params.sq_entries;
+	if (cq_ring != MAP_FAILED)
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_count * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+	if (sqes == MAP_FAILED)
+	{
+		close(fd);
+		return;
+	}
+
+	char* sq = static_cast<char*>(sq_ring);
+	char* cq = static_cast<char*>(cq_ring);
+	sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	// one page-aligned area for all buffers, registered once so that kernel does not need to map them for every request
+	void* memory = nullptr;
+	if (posix_memalign(&memory, 4096, URING_QUEUE_DEPTH * URING_BLOCKSIZE) != 0)
+	{
+		close(fd);
+		return;
+	}
+	buffers = static_cast<char*>(memory);
+	std::vector<iovec> iovecs(URING_QUEUE_DEPTH);
+	slots.resize(URING_QUEUE_DEPTH);
+	for (std::size_t i = 0; i < slots.size(); ++i)
+	{
+		slots[i] = Slot{ buffers + i * URING_BLOCKSIZE, 0, 0, 0, false, false, false };
+		iovecs[i].iov_base = slots[i].buffer;
+		iovecs[i].iov_len = URING_BLOCKSIZE;
+	}
+	if (sys_io_uring_register(fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) != 0)
+	{
+		// e. g. when locked memory is limited (ulimit -l)
+		close(fd);
+		return;
+	}
+	ring_fd = fd;
+}
+
+UringSource::~UringSource()
+{
+	// kernel writes into buffers as long as requests are in flight
+	try
+	{
+		while (in_flight > 0)
+			wait_for_completions();
+	}
+	catch (std::runtime_error const&)
+	{
+	}
+	if (ring_fd >= 0)
+		close(ring_fd);
+	if (sqes != MAP_FAILED)
+		munmap(sqes, sqes_count * sizeof(io_uring_sqe));
+	if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+		munmap(cq_ring, cq_ring_size);
+	if (sq_ring != MAP_FAILED)
+		munmap(sq_ring, sq_ring_size);
+	std::free(buffers);
+	if (file_fd >= 0)
+		close(file_fd);
+}
+
+void UringSource::submit(std::size_t slot_index)
+{
+	Slot& slot = slots[slot_index];
+	// with O_DIRECT, the rest of a short read must start at an aligned offset, so a partly read tail is read again
+	if (direct)
+		slot.filled -= slot.filled % DIRECT_IO_ALIGNMENT;
+	unsigned const tail = *sq_tail;
+	unsigned const index = tail & *sq_mask;
+	io_uring_sqe& sqe = sqes[index];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_READ_FIXED;
+	sqe.fd = file_fd;
+	sqe.off = slot.offset + slot.filled;
+	sqe.addr = reinterpret_cast<unsigned long long>(slot.buffer + slot.filled);
+	sqe.len = static_cast<unsigned>(slot.length - slot.filled);
+	sqe.buf_index = static_cast<unsigned short>(slot_index);
+	sqe.user_data = slot_index;
+	sq_array[index] = index;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	int submitted;
+	do
+		submitted = sys_io_uring_enter(ring_fd, 1, 0, 0);
+	while (submitted < 0 && errno == EINTR);
+	if (submitted < 0)
+		throw std::runtime_error("Input file " + filename + " could not be read: " + std::strerror(errno));
+	if (submitted != 1)
+		throw std::runtime_error("Input file " + filename + " could not be read: io_uring accepted " + std::to_string(submitted) +
+			" instead of 1 read requests.");
+	slot.in_flight = slot.used = true;
+	slot.direct = direct;
+	++in_flight;
+}
+
+void UringSource::wait_for_completions()
+{
+	if (sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+		throw std::runtime_error("Input file " + filename + " could not be read: " + std::strerror(errno));
+
+	unsigned head = *cq_head;
+	unsigned const tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		io_uring_cqe const& cqe = cqes[head & *cq_mask];
+		Slot& slot = slots[cqe.user_data];
+		slot.in_flight = false;
+		--in_flight;
+#ifdef O_DIRECT
+		// like in DescriptorSource: some file systems accept O_DIRECT on open, but not on read, so read on without it
+		if (cqe.res == -EINVAL && slot.direct)
+		{
+			if (direct)
+			{
+				direct = false;
+				drop_cache = true;
+				fcntl(file_fd, F_SETFL, fcntl(file_fd, F_GETFL) & ~O_DIRECT);
+			}
+			submit(cqe.user_data);
+			continue;
+		}
+#endif
+		if (cqe.res < 0)
+		{
+			__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+			throw std::runtime_error("Input file " + filename + " could not be read: " + std::strerror(-cqe.res));
+		}
+		slot.filled += cqe.res;
+		// short read in the middle of file: request the rest
+		if (cqe.res > 0 && slot.filled < slot.length && static_cast<off_t>(slot.offset + slot.filled) < file_size)
+			submit(cqe.user_data);
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+std::size_t UringSource::read(char* dest, std::size_t size)
+{
+	std::size_t copied = 0;
+	while (copied < size)
+	{
+		Slot& slot = slots[curr_slot];
+		if (!slot.used)
+			break; // end of file
+		if (slot.in_flight)
+		{
+			wait_for_completions();
+			continue;
+		}
+		std::size_t const n = std::min(size - copied, slot.filled - curr_pos);
+		std::memcpy(dest + copied, slot.buffer + curr_pos, n);
+		copied += n;
+		curr_pos += n;
+		if (curr_pos == slot.filled)
+		{
+			if (drop_cache)
+				drop_from_page_cache(file_fd, slot.offset, slot.filled);
+			bool const file_shrunk = (slot.filled < slot.length && static_cast<off_t>(slot.offset + slot.filled) < file_size);
+			// reuse slot for next block of file
+			slot.used = false;
+			slot.filled = 0;
+			curr_pos = 0;
+			if (next_offset < file_size && !file_shrunk)
+			{
+				slot.offset = next_offset;
+				slot.length = URING_BLOCKSIZE;
+				next_offset += URING_BLOCKSIZE;
+				submit(curr_slot);
+			}
+			curr_slot = (curr_slot + 1) % slots.size();
+			if (file_shrunk)
+				break;
+		}
+	}
+	return copied;
+}
+
+std::unique_ptr<InputSource> open_uring_input(std::string const& filename, bool direct)
+{
+	std::unique_ptr<UringSource> source(new UringSource(filename, direct));
+	if (!source->ready())
+		return nullptr;
+	return source;
+}
+
+#else
+
+std::unique_ptr<InputSource> open_uring_input(std::string const&, bool)
+{
+	return nullptr;
+}
+
+#endif // SETOP_HAVE_IO_URING
+
+
+std::unique_ptr<InputSource> open_input(std::string const& filename, InputMethod const& method)
+{
+	std::unique_ptr<InputSource> source;
+	if (filename == "-")
+	{
+#ifdef SETOP_HAVE_POSIX
+		source = open_standard_input();
+#endif
+		if (!source)
+			source.reset(new StreamSource());
+	}
+	else if (method.io_uring)
+		source = open_uring_input(filename, method.direct_io);
+#ifdef SETOP_HAVE_POSIX
+	if (!source && method.direct_io)
+	{
+		bool direct = true;
+		int fd = open_file_descriptor(filename, direct);
+		source.reset(new DescriptorSource(fd, "file " + filename, true, direct, !direct));
+	}
+#endif
+	if (!source)
+		source.reset(new StreamSource(filename));
+
+	// decompression costs much more than reading, so always do it in separate thread
+	bool decompressing;
+	source = open_decompressed(std::move(source), (filename == "-" ? "standard input" : "file " + filename), method.threads, decompressing);
+	if (method.pipelined || decompressing)
+		source.reset(new PipelinedSource(std::move(source), PIPELINE_CHUNKSIZE));
+	return source;
+}
+
+
+std::size_t open_files_limit()
+{
+#ifdef SETOP_HAVE_POSIX
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return 0;
+	if (limit.rlim_cur != limit.rlim_max)
+	{
+		rlimit raised = limit;
+		raised.rlim_cur = limit.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+			limit = raised;
+	}
+	return (limit.rlim_cur == RLIM_INFINITY ? 0 : static_cast<std::size_t>(limit.rlim_cur));
+#else
+	return 0;
+#endif
+}
+
+long long file_modification_time(std::string const& filename)
+{
+#ifdef SETOP_HAVE_POSIX
+	struct stat status;
+	if (filename == "-" || stat(filename.c_str(), &status) != 0)
+		return 0;
+	#ifdef __linux__
+		return static_cast<long long>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+	#else
+		return static_cast<long long>(status.st_mtime) * 1000000000;
+	#endif
+#else
+	(void)filename;
+	return 0;
+#endif
+}
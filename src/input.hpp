@@ -0,0 +1,146 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_INPUT_HPP
+#define SETOP_INPUT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <istream>
+#include <thread>
+
+#include "pipeline.hpp"
+
+
+/**
+\file
+\brief Sources of raw input bytes (files, standard input) for parsing input elements
+*/
+
+
+/**
+\brief Interface for everything input elements can be read from
+\details Contrary to plain POSIX read, read fills the whole destination as long as the input is not at its end,
+	i. e. a short read always means end of input (like std::istream::read).
+*/
+class InputSource
+{
+public:
+	virtual ~InputSource() {}
+
+	/**
+	\brief Reads up to size bytes into dest.
+	\return number of bytes read, smaller than size only at end of input
+	\throws std::runtime_error
+	*/
+	virtual std::size_t read(char* dest, std::size_t size) = 0;
+};
+
+
+/** \brief Input from a std::istream, i. e. std::cin or a file opened by std::ifstream */
+class StreamSource : public InputSource
+{
+public:
+	/** \brief Reads from standard input. */
+	StreamSource();
+	/**
+	\brief Reads from given file.
+	\throws std::runtime_error
+	*/
+	explicit StreamSource(std::string const& filename);
+
+	std::size_t read(char* dest, std::size_t size) override;
+
+private:
+	std::unique_ptr<char[]> buffer; ///< buffer of inputfile, must live longer than inputfile
+	std::ifstream inputfile;
+	std::istream& inputstream;
+};
+
+
+/**
+\brief Reads another input source in a separate thread, so that reading and parsing of input overlap
+\details The reader thread fills a few chunks in advance (triple buffering); chunks are recycled after being consumed.
+	This hides latencies of slow devices, network file systems or decompression.
+*/
+class PipelinedSource : public InputSource
+{
+public:
+	/**
+	\param source input to read in background, taken over
+	\param chunksize number of bytes read at once by reader thread
+	\param chunks number of chunks in flight
+	*/
+	PipelinedSource(std::unique_ptr<InputSource> source, std::size_t chunksize, std::size_t chunks = 3);
+	~PipelinedSource() override;
+
+	std::size_t read(char* dest, std::size_t size) override;
+
+private:
+	typedef std::vector<char> chunk_t;
+
+	void run_reader();
+
+	std::unique_ptr<InputSource> source;
+	std::size_t const chunksize;
+	BoundedQueue<chunk_t> filled_chunks; ///< chunks read, in order of input
+	BoundedQueue<chunk_t> free_chunks; ///< chunks already consumed and ready for reuse
+	chunk_t curr_chunk; ///< chunk currently consumed by read
+	std::size_t curr_pos; ///< first byte in curr_chunk not consumed yet
+	bool at_end;
+	PipelineError reader_error;
+	std::thread reader;
+};
+
+
+/**
+\brief Tries to open a regular file for reading with io_uring (Linux only).
+\details The file is read in large blocks with many requests in flight, see UringSource in input.cpp.
+\param filename name of input file
+\param direct bypass page cache, see InputMethod::direct_io
+\return nullptr if io_uring is not supported (by build, kernel, or permissions) or file is not a regular file
+\throws std::runtime_error if file could not be opened
+*/
+std::unique_ptr<InputSource> open_uring_input(std::string const& filename, bool direct);
+
+
+/** \brief How input files and streams are read */
+struct InputMethod
+{
+	bool pipelined; ///< read in separate thread, see PipelinedSource
+	bool io_uring; ///< read regular files with io_uring, see UringSource
+	bool direct_io; ///< read files without filling the page cache (O_DIRECT or dropping pages after reading)
+	unsigned threads; ///< maximal number of threads for decompressing one input
+};
+
+/**
+\brief Opens input file or standard input (filename "-") according to input options.
+\details Compressed inputs are recognized and decompressed in a separate thread, see open_decompressed.
+\throws std::runtime_error
+*/
+std::unique_ptr<InputSource> open_input(std::string const& filename, InputMethod const& method);
+
+/** \brief Returns time of last modification of file (in nanoseconds if available), 0 if unknown (e. g. for standard input "-"). */
+long long file_modification_time(std::string const& filename);
+
+/**
+\brief Returns maximal number of files this process may have open at once, raising the soft limit up to the hard limit first.
+\return 0 if there is no such limit (or it is unknown on this platform)
+*/
+std::size_t open_files_limit();
+
+#endif // SETOP_INPUT_HPP
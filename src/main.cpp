@@ -20,8 +20,19 @@ You can find a copy of the GNU General Public License at <http://www.gnu.org/lic
 #include <vector>
 #include <fstream>
 #include <functional>
+#include <algorithm>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <queue>
+#include <chrono>
 
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -29,6 +40,12 @@ You can find a copy of the GNU General Public License at <http://www.gnu.org/lic
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/regex.hpp>
 
+#include "input.hpp"
+#include "output.hpp"
+#include "compress.hpp"
+#include "pipeline.hpp"
+#include "regex_engine.hpp"
+
 
 /**
 \file
@@ -51,6 +68,46 @@ You can find a copy of the GNU General Public License at <http://www.gnu.org/lic
 	at least it should be much bigger than expected size of elements
 */
 #define INITIAL_BUFFERSIZE 4096
+/** \brief minimal number of bytes searched by each thread when input is tokenized in parallel (see find_matches) */
+#define PARSE_CHUNKSIZE (1 << 20)
+/** \brief number of slots of cache for recently found elements, see RecentElements */
+#define RECENT_ELEMENTS_SLOTS 4096
+/** \brief longer elements are not cached, comparing and copying them would cost about as much as inserting them */
+#define RECENT_ELEMENTS_MAX_LENGTH 256
+/** \brief number of lookups after which cache for recently found elements is switched off if less than an eighth of them were hits */
+#define RECENT_ELEMENTS_PROBE (1 << 16)
+/** \brief number of elements found in read buffer that are filtered, trimmed, and passed to consumer together, see parse_input */
+#define PARSE_BATCHSIZE 1024
+/** \brief a set is searched for each element of another set (instead of walking through both) if that is this many times smaller, see filter_set */
+#define SET_PROBE_RATIO 16
+/** \brief number of elements handed over at once from parsing to inserting thread when input is pipelined */
+#define PIPELINE_BATCHSIZE 1024
+/** \brief number of element batches that may wait for insertion when input is pipelined */
+#define PIPELINE_BATCHES 8
+/** \brief size of buffer for each bucket file when inputs are partitioned into buckets (see execute_in_buckets) */
+#define BUCKET_BUFFERSIZE (64 << 10)
+/** \brief minimal size of buffer for each bucket file, buffers are smaller than BUCKET_BUFFERSIZE if all of them would exceed the memory limit */
+#define BUCKET_MIN_BUFFERSIZE (4 << 10)
+/** \brief maximal number of buckets, each input has a file open for each bucket while it is partitioned (see max_buckets) */
+#define MAX_BUCKETS 4096
+/** \brief maximal number of worker processes per processor, see option workers */
+#define WORKERS_PER_PROCESSOR 4
+/** \brief number of files that may be open besides those of the buckets (inputs, output, temporary files of workers etc.) */
+#define BUCKET_FILES_RESERVE 32
+/**
+\brief estimated memory needed by an element in a set besides its characters
+\details node of red-black tree (pointers and color) and std::string object, both with some overhead of memory allocation
+*/
+#define SET_ELEMENT_OVERHEAD (48 + sizeof(element_t))
+/**
+\brief estimated ratio of memory needed for set to size of input file, used for choosing number of buckets when memory limit is reached
+\details high for short elements (lines of 10 characters need about 8 times their size), near 1 for long ones
+*/
+#define INPUT_MEMORY_RATIO 8
+/** \brief first word of checkpoint state file, changed on incompatible changes of checkpoints */
+#define CHECKPOINT_VERSION "setop-checkpoint-1"
+/** \brief beginning of names of all checkpoint files, so that other files in checkpoint directory are never touched */
+#define CHECKPOINT_PREFIX "setop-checkpoint."
 
 /** \brief all possible commutative set operations */
 enum class SetConcat : unsigned char { UNION, INTERSECTION, SYM_DIFFERENCE };
@@ -77,10 +134,111 @@ public:
 	bool include_empty_elements; ///< empty input elements are included instead of ignored
 	boost::regex input_element_regex; ///< regular expression describing an input element (use boost instead of std because match_partial is needed)
 	boost::regex input_separator_regex; ///< regular expression describing an input separator
+	std::shared_ptr<RegexEngine const> input_engine; ///< engine for regex used for parsing, null for Boost.Regex (cloned for each input because not thread-safe)
 	std::string output_separator; ///< string elements shall be separated with in output
 	std::string trim_characters; ///< list of characters that shall be ignored in element at begin and end
+	InputMethod input_method; ///< how input files are read, e. g. in separate thread
+	std::size_t max_memory; ///< maximal (estimated) memory for sets of elements, 0 for unlimited
 } input_opts;
 
+/** \brief Encapsulates all options for writing output. */
+class OutputOptions
+{
+public:
+	OutputMethod output_method; ///< how output is written, e. g. in separate thread
+	bool escape_elements; ///< write backslash and whitespace control characters in elements as escape sequences
+	Compression compression; ///< format for compressing output
+	int compression_level; ///< COMPRESSION_LEVEL_DEFAULT for default level of compression format
+	unsigned compression_threads; ///< maximal number of blocks compressed in parallel
+	unsigned partitions; ///< number of files the set is written to, 0 for writing it to standard output
+	std::string partition_prefix; ///< beginning of file names of partitions, followed by partition number
+	bool partition_by_range; ///< partition sorted set into contiguous ranges instead of by hash value of elements
+	bool binary; ///< write elements length-prefixed (see format_element) instead of separated
+	bool binary_header; ///< start binary output with header (see write_binary_header)
+} output_opts;
+
+
+/** \brief Value of a command line option consisting of exactly two tokens (e. g. number and file name) */
+class TwoTokenValue : public boost::program_options::typed_value<std::vector<std::string>>
+{
+public:
+	explicit TwoTokenValue(std::vector<std::string>* store_to) : typed_value(store_to) {}
+	unsigned min_tokens() const override { return 2; }
+	unsigned max_tokens() const override { return 2; }
+};
+
+
+/** \brief Thrown when sets of elements would need more memory than allowed by --max-memory */
+class MemoryLimitExceeded : public std::runtime_error
+{
+public:
+	explicit MemoryLimitExceeded(std::string const& what) : std::runtime_error(what) {}
+};
+
+/** \brief Returns estimated memory needed by element in a set. */
+inline std::size_t element_footprint(element_t const& el)
+{
+	// short strings are stored inside of std::string object
+	return SET_ELEMENT_OVERHEAD + (el.capacity() >= sizeof(element_t) ? el.capacity() + 1 : 0);
+}
+
+/** \brief Returns estimated memory needed by set. */
+std::size_t set_footprint(set_t const& elements)
+{
+	std::size_t footprint = 0;
+	for (element_t const& el : elements)
+		footprint += element_footprint(el);
+	return footprint;
+}
+
+/**
+\brief Returns memory left for another set besides a set of given estimated memory according to limit of input options.
+\return 0 if memory is unlimited
+\throws MemoryLimitExceeded if nothing is left
+*/
+std::size_t memory_left(std::size_t footprint)
+{
+	if (input_opts.max_memory == 0)
+		return 0;
+	if (footprint >= input_opts.max_memory)
+		throw MemoryLimitExceeded("Memory limit exceeded by resulting set.");
+	return input_opts.max_memory - footprint;
+}
+
+/** \brief Returns size of file in bytes, 0 if unknown. */
+unsigned long long file_size(std::string const& filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	std::streamoff const size = (file ? static_cast<std::streamoff>(file.tellg()) : 0);
+	return size > 0 ? static_cast<unsigned long long>(size) : 0;
+}
+
+/**
+\brief Parses size with optional binary suffix K, M, G, or T like 512M.
+\throws std::invalid_argument
+*/
+std::size_t parse_size(std::string const& size_str)
+{
+	std::size_t parsed_chars = 0;
+	unsigned long long size = 0;
+	try
+	{
+		size = std::stoull(size_str, &parsed_chars);
+	}
+	catch (std::logic_error const&)
+	{
+		parsed_chars = 0;
+	}
+	std::string const suffixes = "KMGT";
+	std::size_t const suffix = (parsed_chars + 1 == size_str.size() ? suffixes.find(std::toupper(size_str.back())) : std::string::npos);
+	if (parsed_chars == 0 || (parsed_chars != size_str.size() && suffix == std::string::npos) || size_str[0] == '-')
+		throw std::invalid_argument("\"" + size_str + "\" is no valid size.");
+	unsigned const shift = (suffix != std::string::npos ? 10 * (suffix + 1) : 0);
+	if (size > (std::numeric_limits<std::size_t>::max() >> shift))
+		throw std::invalid_argument("\"" + size_str + "\" is too large.");
+	return static_cast<std::size_t>(size << shift);
+}
+
 
 /**
 \brief Parses escape sequences like \\n and \\t to “real” characters (e. g. .\\'\\\\\\" gets .'\\")
@@ -129,34 +287,149 @@ std::string unescape_sequence(std::string const& escape_seq)
 }
 
 
+/** \brief element found in read buffer, not copied yet */
+struct ElementRange
+{
+	char const* first;
+	char const* last;
+};
+
 /**
-\brief Returns all elements from file as a set.
-\param filename name of input file with elements to parse
+\brief Cache for elements recently found in an input, before they are filtered and trimmed
+\details Inputs like logs repeat the same elements again and again. All consumers of parse_input build sets, so an element
+	found again would not change anything and can be skipped before copying, filtering, trimming, and inserting it.
+	Each slot holds the last element with its hash value. If only few lookups are hits (inputs of mostly different elements),
+	the cache switches itself off.
 */
-set_t file_to_set(std::string const& filename)
+class RecentElements
 {
-	set_t result(input_opts.element_comp);
+public:
+	RecentElements() : slots(RECENT_ELEMENTS_SLOTS), lookups(0), hits(0), active(true) {}
+
+	/**
+	\brief Removes elements in cache from batch, puts the others there.
+	\details All hash values are computed first and their slots are prefetched, so that the slots are in cache
+		when they are compared one after another (in order of batch, so repetitions within batch are found, too).
+	*/
+	void remove_found(std::vector<ElementRange>& batch)
+	{
+		if (!active)
+			return;
+
+		slot_indices.resize(batch.size());
+		for (std::size_t i = 0; i < batch.size(); ++i)
+		{
+			std::size_t const length = batch[i].last - batch[i].first;
+			if (length > RECENT_ELEMENTS_MAX_LENGTH)
+			{
+				slot_indices[i] = RECENT_ELEMENTS_SLOTS;
+				continue;
+			}
+			// FNV-1a
+			std::uint64_t hash = 14695981039346656037ull;
+			for (char const* curr = batch[i].first; curr != batch[i].last; ++curr)
+			{
+				hash ^= static_cast<unsigned char>(*curr);
+				hash *= 1099511628211ull;
+			}
+			slot_indices[i] = hash % RECENT_ELEMENTS_SLOTS;
+#ifdef __GNUC__
+			__builtin_prefetch(&slots[slot_indices[i]]);
+#endif
+		}
+
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < batch.size(); ++i)
+		{
+			if (slot_indices[i] == RECENT_ELEMENTS_SLOTS || !contains(slots[slot_indices[i]], batch[i]))
+				batch[kept++] = batch[i];
+		}
+		batch.resize(kept);
+	}
+
+private:
+	struct Slot
+	{
+		bool used = false;
+		element_t element;
+	};
 
-	// set input stream (can be std::cin)
-	std::ifstream inputfile;
-	if (filename != "-")
+	/** \brief Returns if element is in slot, otherwise puts it there. */
+	bool contains(Slot& slot, ElementRange const& element)
 	{
-		inputfile.open(filename);
-		if (!inputfile)
-			throw std::runtime_error("Input file " + filename + " could not be opened.");
+		std::size_t const length = element.last - element.first;
+		bool const found = (slot.used && slot.element.size() == length && std::memcmp(slot.element.data(), element.first, length) == 0);
+		if (found)
+		{
+			++hits;
+		}
+		else
+		{
+			slot.used = true;
+			slot.element.assign(element.first, element.last);
+		}
+
+		if (++lookups == RECENT_ELEMENTS_PROBE)
+		{
+			active = (hits >= lookups / 8);
+			lookups = hits = 0;
+		}
+		return found;
 	}
-	std::istream& inputstream = (filename == "-" ? std::cin : inputfile);
 
-	// lambda for running adjust_element and inserting it right after (according to options)
-	auto adjust_and_insert_element = [&result](element_t el_str, bool check_element_regex = false)
+	std::vector<Slot> slots;
+	std::vector<std::size_t> slot_indices; ///< for each element of current batch, RECENT_ELEMENTS_SLOTS if not cached
+	std::size_t lookups, hits; ///< since last check if cache is worth it
+	bool active;
+};
+
+/**
+\brief Parses all elements from file and passes each one to consumer.
+\param filename name of input file with elements to parse
+\param consume function called with each element (char const* first, char const* last) in order of input;
+	the characters are only valid during the call (they are part of the read buffer); repetitions of an element may be left out
+*/
+template <typename Consumer>
+void parse_input(std::string const& filename, Consumer&& consume)
+{
+	// set input stream (can be std::cin), maybe read in separate thread
+	std::unique_ptr<InputSource> inputsource = open_input(filename, input_opts.input_method);
+
+	// elements are collected in batches and stay in buffer while filtering and trimming, the consumer copies them if needed;
+	// each step runs over the whole batch in a tight loop (instead of all steps for one element after another)
+	bool trim_character[256] = {};
+	for (char c : input_opts.trim_characters)
+		trim_character[static_cast<unsigned char>(c)] = true;
+	bool const trim = !input_opts.trim_characters.empty();
+	RecentElements recent_elements;
+	std::vector<ElementRange> batch;
+	batch.reserve(PARSE_BATCHSIZE);
+	// lambda for passing all elements of batch to consumer after adjusting them (according to options), must be called before buffer changes
+	auto flush_batch = [&consume, &recent_elements, &trim_character, trim, &batch]()
 	{
-		if (!check_element_regex || input_opts.input_element_regex.empty() ||
-			boost::regex_match(el_str.begin(), el_str.end(), input_opts.input_element_regex, boost::match_default))
+		recent_elements.remove_found(batch);
+		if (trim)
 		{
-			boost::trim_if(el_str, boost::is_any_of(input_opts.trim_characters));
-			if (!el_str.empty() || input_opts.include_empty_elements)
-				result.insert(std::move(el_str));
+			for (ElementRange& element : batch)
+			{
+				while (element.first != element.last && trim_character[static_cast<unsigned char>(*element.first)])
+					++element.first;
+				while (element.first != element.last && trim_character[static_cast<unsigned char>(element.last[-1])])
+					--element.last;
+			}
 		}
+		if (!input_opts.include_empty_elements)
+			batch.erase(std::remove_if(batch.begin(), batch.end(),
+				[](ElementRange const& element) { return element.first == element.last; }), batch.end());
+		for (ElementRange const& element : batch)
+			consume(element.first, element.last);
+		batch.clear();
+	};
+	auto add_element = [&batch, &flush_batch](char const* first, char const* last)
+	{
+		batch.push_back(ElementRange{ first, last });
+		if (batch.size() == PARSE_BATCHSIZE)
+			flush_batch();
 	};
 
 	// FIRST METHOD: parse input according to list of delimiter characters
@@ -210,10 +483,81 @@ set_t file_to_set(std::string const& filename)
 	std::size_t used_buffer = 0;
 	// use unique pointer instead of "plain" pointer so that there is no memory leak in case of exception
 	std::unique_ptr<char[]> buffer(new char[buffersize]);
+	bool input_at_end;
+
+	// THIRD METHOD: same as second one, but with another engine (e. g. linear-time automaton without backtracking)
+	if (input_opts.input_engine)
+	{
+		// search large buffers in parallel if pattern is complex enough to be worth it
+		std::vector<std::unique_ptr<RegexEngine>> engines;
+		engines.push_back(input_opts.input_engine->clone());
+		if (input_opts.input_engine->parallelizable())
+			while (engines.size() < input_opts.input_method.threads)
+				engines.push_back(input_opts.input_engine->clone());
+		if (engines.size() > 1)
+		{
+			buffersize = engines.size() * PARSE_CHUNKSIZE;
+			buffer.reset(new char[buffersize]);
+		}
+		std::size_t search_from = 0; // offset in buffer where no match can begin before (rest of last search)
+		do
+		{
+			std::size_t const bytes_to_read = buffersize - used_buffer;
+			std::size_t const bytes_read = inputsource->read(buffer.get() + used_buffer, bytes_to_read);
+			input_at_end = (bytes_read < bytes_to_read);
+			char const* const buffer_end = buffer.get() + used_buffer + bytes_read;
+			char const* buffer_handled_until = buffer.get();
+			char const* const search_begin = buffer.get() + search_from;
+
+			MatchScan const scan = (engines.size() > 1 && static_cast<std::size_t>(buffer_end - search_begin) >= 2 * PARSE_CHUNKSIZE ?
+				find_matches(engines, search_begin, buffer_end, input_at_end, PARSE_CHUNKSIZE) :
+				scan_matches(*engines.front(), search_begin, buffer_end, buffer_end, input_at_end));
+			for (RegexEngine::Match const& match : scan.matches)
+			{
+				if (use_separator_regex)
+				{
+					add_element(buffer_handled_until, match.first);
+					buffer_handled_until = match.last;
+				}
+				else
+				{
+					add_element(match.first, match.last);
+				}
+			}
+			flush_batch();
+			// keep rest of buffer for next round, for a separator also the element in front of it
+			char const* const pos = (scan.tail.status == RegexEngine::Match::MORE ? scan.tail.last : buffer_end);
+			if (!use_separator_regex)
+				buffer_handled_until = pos;
+
+			used_buffer = buffer_end - buffer_handled_until;
+			search_from = pos - buffer_handled_until;
+			if (buffer_handled_until == buffer.get())
+			{
+				// if current element fills the whole buffer, buffer is too small and thus doubled
+				buffersize *= 2;
+				std::unique_ptr<char[]> new_buffer(new char[buffersize]);
+				std::memmove(new_buffer.get(), buffer_handled_until, used_buffer);
+				buffer = std::move(new_buffer);
+			}
+			else
+			{
+				std::memmove(buffer.get(), buffer_handled_until, used_buffer);
+			}
+		} while (!input_at_end);
+
+		if (use_separator_regex && used_buffer > 0)
+			add_element(buffer.get(), buffer.get() + used_buffer);
+		flush_batch();
+		return;
+	}
+
 	do
 	{
-		inputstream.read(buffer.get() + used_buffer, buffersize - used_buffer);
-		char const* const buffer_end = buffer.get() + used_buffer + inputstream.gcount();
+		std::size_t const bytes_to_read = buffersize - used_buffer;
+		std::size_t const bytes_read = inputsource->read(buffer.get() + used_buffer, bytes_to_read);
+		input_at_end = (bytes_read < bytes_to_read);
+		char const* const buffer_end = buffer.get() + used_buffer + bytes_read;
 		char const* buffer_handled_until = buffer.get();
 
 		// the whole following thing could be much easier by using a bidirectional input iterator here, but:
@@ -224,21 +568,22 @@ set_t file_to_set(std::string const& filename)
 		// add element to set when ...
 		while (curr_match != boost::cregex_iterator() &&
 			curr_match->begin()->matched && // ... match is a full match and ...
-			(!inputstream || // ... when file is at end or ...
+			(input_at_end || // ... when file is at end or ...
 			// (see next line) when match does not touch end of buffer (otherwise element could be longer, e. g. partial match)
 			!boost::regex_match(curr_match->begin()->first, buffer_end, regex, boost::match_default | boost::match_partial)))
 		{
 			if (use_separator_regex)
 			{
-				adjust_and_insert_element(element_t(buffer_handled_until, curr_match->begin()->first), true);
+				add_element(buffer_handled_until, curr_match->begin()->first);
 				buffer_handled_until = curr_match->begin()->second;
 			}
 			else
 			{
-				adjust_and_insert_element(curr_match->str());
+				add_element(curr_match->begin()->first, curr_match->begin()->second);
 			}
 			++curr_match;
 		}
+		flush_batch();
 		if (!use_separator_regex)
 			// the last match is always a partial match except full match touches buffer end (or buffer is empty)
 			// so mark begin of last match as new begin of buffer when filling it up in next round of do-while-loop
@@ -259,14 +604,829 @@ set_t file_to_set(std::string const& filename)
 			// move the rest of new element (buffer_handled_until) to beginning of buffer and mark it as used
 			std::memmove(buffer.get(), buffer_handled_until, used_buffer);
 		}
-	} while (inputstream);
+	} while (!input_at_end);
 
 	if (use_separator_regex && used_buffer > 0)
-		adjust_and_insert_element(element_t(buffer.get(), used_buffer), true);
+		add_element(buffer.get(), buffer.get() + used_buffer);
+	flush_batch();
+}
+
+/**
+\brief Returns all elements from file as a set.
+\param filename name of input file with elements to parse
+\param memory_limit maximal estimated memory of resulting set, 0 for unlimited
+\param[out] footprint if not null, estimated memory of resulting set (see element_footprint)
+\throws MemoryLimitExceeded
+*/
+set_t file_to_set(std::string const& filename, std::size_t memory_limit = 0, std::size_t* footprint = nullptr)
+{
+	set_t result(input_opts.element_comp);
+	std::size_t result_footprint = 0;
+	// looks up element before copying it into set (or taking it over if movable), so nothing is allocated for repetitions
+	auto insert_element = [&result, &result_footprint, memory_limit, &filename](element_t& el, bool movable)
+	{
+		auto position = result.lower_bound(el);
+		if (position != result.end() && !result.key_comp()(el, *position))
+			return;
+		position = (movable ? result.emplace_hint(position, std::move(el)) : result.emplace_hint(position, el));
+		result_footprint += element_footprint(*position);
+		if (memory_limit > 0 && result_footprint > memory_limit)
+			throw MemoryLimitExceeded("Memory limit exceeded while reading " + filename + ".");
+	};
+
+	// when pipelined, elements are collected in batches and inserted into result in separate thread
+	typedef std::vector<element_t> batch_t;
+	batch_t batch;
+	BoundedQueue<batch_t> batches(PIPELINE_BATCHES);
+	PipelineError inserter_error;
+	std::thread inserter;
+	if (input_opts.input_method.pipelined)
+	{
+		batch.reserve(PIPELINE_BATCHSIZE);
+		inserter = std::thread([&insert_element, &batches, &inserter_error]()
+		{
+			try
+			{
+				batch_t curr_batch;
+				while (batches.pop(curr_batch))
+					for (element_t& el : curr_batch)
+						insert_element(el, true);
+			}
+			catch (...)
+			{
+				inserter_error.store_current();
+				batches.close();
+			}
+		});
+	}
+	// inserting thread must be stopped in any case, also when parsing throws an exception
+	struct InserterGuard
+	{
+		BoundedQueue<batch_t>& batches;
+		std::thread& inserter;
+		~InserterGuard()
+		{
+			batches.close();
+			if (inserter.joinable())
+				inserter.join();
+		}
+	} inserter_guard = { batches, inserter };
+
+	element_t curr_element; // reused for each element, so that it only allocates memory for long elements
+	parse_input(filename, [&insert_element, &curr_element, &batch, &batches, &inserter_error](char const* first, char const* last)
+	{
+		if (!input_opts.input_method.pipelined)
+		{
+			curr_element.assign(first, last);
+			insert_element(curr_element, false);
+		}
+		else
+		{
+			batch.emplace_back(first, last);
+			if (batch.size() == PIPELINE_BATCHSIZE)
+			{
+				if (!batches.push(std::move(batch)))
+					inserter_error.rethrow();
+				batch.clear();
+			}
+		}
+	});
+
+	if (input_opts.input_method.pipelined)
+	{
+		if (!batch.empty() && !batches.push(std::move(batch)))
+			inserter_error.rethrow();
+		batches.close();
+		inserter.join();
+		inserter_error.rethrow();
+	}
+
+	if (footprint)
+		*footprint = result_footprint;
+	return result;
+}
+
+/** \brief magic bytes at beginning of binary output with header */
+#define BINARY_MAGIC "SETOP"
+/** \brief version of binary output format, increased on incompatible changes */
+#define BINARY_VERSION 1
+/** \brief flag in header of binary output: elements were compared case-insensitive */
+#define BINARY_FLAG_IGNORE_CASE 1
+
+/**
+\brief Appends element to dest as desired by output options.
+\details In binary format an element is its length as varint (see append_varint) followed by its bytes, so it may contain any byte.
+	Otherwise the element (maybe escaped) is followed by output separator.
+*/
+void format_element(OutputBuffer& dest, element_t const& el)
+{
+	if (output_opts.binary)
+	{
+		append_varint(dest, el.size());
+		dest.insert(dest.end(), el.begin(), el.end());
+		return;
+	}
+	if (output_opts.escape_elements)
+		append_escaped(dest, el.data(), el.size());
+	else
+		dest.insert(dest.end(), el.begin(), el.end());
+	dest.insert(dest.end(), input_opts.output_separator.begin(), input_opts.output_separator.end());
+}
+
+/**
+\brief Writes header of binary output, if desired.
+\details The header is BINARY_MAGIC (5 bytes), BINARY_VERSION (1 byte), flags (varint, see BINARY_FLAG_*),
+	and number of elements following (varint).
+*/
+void write_binary_header(OutputWriter& writer, std::size_t count, bool ignore_case)
+{
+	if (!output_opts.binary || !output_opts.binary_header)
+		return;
+	OutputBuffer header(BINARY_MAGIC, BINARY_MAGIC + std::strlen(BINARY_MAGIC));
+	header.push_back(BINARY_VERSION);
+	append_varint(header, ignore_case ? BINARY_FLAG_IGNORE_CASE : 0);
+	append_varint(header, count);
+	writer.append(header.data(), header.size());
+}
+
+/**
+\brief Hash value of element for partitioning output
+\details FNV-1a instead of std::hash, so that partitions are the same with every build of setop.
+	With -C, elements differing in case only are never both part of the set, so they need no equal hash value.
+*/
+std::uint64_t partition_hash(element_t const& el)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	for (char c : el)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+\brief Writes set into several files (partitions) in parallel as desired by output options.
+\details Each element is assigned to a partition in one pass, after that each partition is formatted and written (and compressed)
+	by its own thread, with at most as many threads as allowed. Elements are sorted within each partition.
+\throws std::runtime_error
+*/
+void write_partitions(set_t const& output_set, bool ignore_case)
+{
+	unsigned const partitions = output_opts.partitions;
+	std::vector<std::vector<element_t const*>> partition_elements(partitions);
+	std::size_t index = 0;
+	for (element_t const& el : output_set)
+	{
+		std::size_t const partition = output_opts.partition_by_range ?
+			index++ * partitions / output_set.size() :
+			partition_hash(el) % partitions;
+		partition_elements[partition].push_back(&el);
+	}
+
+	char const* const extension =
+		output_opts.compression == Compression::GZIP ? ".gz" :
+		output_opts.compression == Compression::ZSTD ? ".zst" :
+		"";
+	unsigned const workers = std::min(output_opts.output_method.threads, partitions);
+	unsigned const compression_threads = std::max(1u, output_opts.compression_threads / workers);
+	OutputMethod const partition_method = { false, 1, false };
+	std::atomic<unsigned> next_partition(0);
+	auto write_next_partitions = [&]()
+	{
+		for (unsigned partition; (partition = next_partition++) < partitions; )
+		{
+			char number[16];
+			std::snprintf(number, sizeof(number), "%05u", partition);
+			OutputWriter writer(open_compressed_output(open_output_file(output_opts.partition_prefix + number + extension),
+				output_opts.compression, output_opts.compression_level, compression_threads), partition_method);
+			write_binary_header(writer, partition_elements[partition].size(), ignore_case);
+			write_formatted(writer, partition_elements[partition].begin(), partition_elements[partition].end(),
+				[](OutputBuffer& dest, element_t const* el) { format_element(dest, *el); }, 1);
+			writer.finish();
+		}
+	};
+
+	std::vector<std::future<void>> other_workers;
+	for (unsigned i = 1; i < workers; ++i)
+		other_workers.push_back(std::async(std::launch::async, write_next_partitions));
+	write_next_partitions();
+	for (std::future<void>& worker : other_workers)
+		worker.get();
+}
+
+/**
+\brief Removes elements from set that are in another set, or those that are not.
+\details Both sets are sorted the same way, so usually they are walked through side by side (like std::set_difference)
+	instead of searching each element in the other tree: every node is visited once and in order, whereas each search
+	descends the tree from its root and waits for memory at nearly every node.
+	If one set is much smaller (see SET_PROBE_RATIO), its elements are searched in the other one instead.
+	Elements kept are always those of output_set (they can differ from equal ones of other when ignoring case).
+\param output_set set to remove elements from
+\param other set to compare with
+\param keep_common true for intersection (remove elements not in other), false for difference (remove elements in other)
+\param[in,out] footprint if not null, estimated memory of output_set (see element_footprint), kept up to date
+*/
+void filter_set(set_t& output_set, set_t const& other, bool keep_common, std::size_t* footprint = nullptr)
+{
+	auto erase = [&output_set, footprint](set_t::const_iterator it) -> set_t::const_iterator
+	{
+		if (footprint)
+			*footprint -= element_footprint(*it);
+		return output_set.erase(it);
+	};
+
+	if (output_set.size() < other.size() / SET_PROBE_RATIO)
+	{
+		for (set_t::const_iterator out = output_set.begin(); out != output_set.end(); )
+			out = ((other.find(*out) != other.end()) == keep_common ? std::next(out) : erase(out));
+	}
+	else if (other.size() < output_set.size() / SET_PROBE_RATIO)
+	{
+		if (keep_common)
+		{
+			set_t intersect(input_opts.element_comp);
+			std::size_t intersect_footprint = 0;
+			for (element_t const& el : other)
+			{
+				set_t::const_iterator it = output_set.find(el);
+				if (it != output_set.end())
+					intersect_footprint += element_footprint(*intersect.emplace_hint(intersect.end(), *it));
+			}
+			output_set = std::move(intersect);
+			if (footprint)
+				*footprint = intersect_footprint;
+		}
+		else
+		{
+			for (element_t const& el : other)
+			{
+				set_t::const_iterator it = output_set.find(el);
+				if (it != output_set.end())
+					erase(it);
+			}
+		}
+	}
+	else
+	{
+		el_comp_t const& comp = input_opts.element_comp;
+		set_t::const_iterator out = output_set.begin();
+		set_t::const_iterator in = other.begin();
+		while (out != output_set.end() && in != other.end())
+		{
+			if (comp(*out, *in))
+			{
+				out = (keep_common ? erase(out) : std::next(out));
+			}
+			else if (comp(*in, *out))
+			{
+				++in;
+			}
+			else
+			{
+				out = (keep_common ? std::next(out) : erase(out));
+				++in;
+			}
+		}
+		if (keep_common)
+			while (out != output_set.end())
+				out = erase(out);
+	}
+}
+
+/**
+\brief Combines set with another one by commutative set operation.
+\param output_set first operand and result
+\param curr_set second operand, may be moved from
+\param set_concat_type union, intersection, or symmetric difference
+\param[in,out] footprint if not null, estimated memory of output_set (see element_footprint), kept up to date
+*/
+void combine_sets(set_t& output_set, set_t&& curr_set, SetConcat set_concat_type, std::size_t* footprint = nullptr)
+{
+	// inserts element at position (or right before it) and keeps footprint up to date
+	auto insert = [&output_set, footprint](set_t::const_iterator position, element_t const& el) -> set_t::const_iterator
+	{
+		std::size_t const size = output_set.size();
+		set_t::const_iterator const inserted = output_set.insert(position, el);
+		if (footprint && output_set.size() != size)
+			*footprint += element_footprint(*inserted);
+		return inserted;
+	};
+
+	switch (set_concat_type)
+	{
+	case SetConcat::UNION:
+	{
+		// elements of curr_set are sorted, so each one belongs behind the previous one
+		set_t::const_iterator position = output_set.begin();
+		for (element_t const& el : curr_set)
+			position = std::next(insert(position, el));
+		break;
+	}
+	case SetConcat::INTERSECTION:
+		filter_set(output_set, curr_set, true, footprint);
+		break;
+	case SetConcat::SYM_DIFFERENCE:
+		if (curr_set.size() < output_set.size() / SET_PROBE_RATIO)
+		{
+			for (element_t const& el : curr_set)
+			{
+				set_t::const_iterator it = output_set.find(el);
+				if (it != output_set.end())
+				{
+					if (footprint)
+						*footprint -= element_footprint(*it);
+					output_set.erase(it);
+				}
+				else
+				{
+					insert(output_set.end(), el);
+				}
+			}
+		}
+		else
+		{
+			// walk through both sets side by side like filter_set, new elements are inserted right before the current one
+			el_comp_t const& comp = input_opts.element_comp;
+			set_t::const_iterator out = output_set.begin();
+			for (element_t const& el : curr_set)
+			{
+				while (out != output_set.end() && comp(*out, el))
+					++out;
+				if (out != output_set.end() && !comp(el, *out))
+				{
+					if (footprint)
+						*footprint -= element_footprint(*out);
+					out = output_set.erase(out);
+				}
+				else
+				{
+					insert(out, el);
+				}
+			}
+		}
+	}
+}
 
+
+/** \brief Reads file of length-prefixed elements (like binary output without header) element by element. */
+class ElementFileReader
+{
+public:
+	explicit ElementFileReader(std::string const& path) : path(path), file(path, std::ios::binary)
+	{
+		if (!file)
+			throw std::runtime_error("Element file " + path + " could not be opened.");
+	}
+
+	/** \brief Reads next element into current, returns false at end of file. */
+	bool next()
+	{
+		std::uint64_t size = 0;
+		int byte = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7)
+		{
+			if ((byte = file.get()) == std::char_traits<char>::eof())
+			{
+				if (shift == 0)
+					return false;
+				break;
+			}
+			size |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+			if (byte < 0x80)
+				break;
+		}
+		current.resize(static_cast<std::size_t>(size));
+		if (byte >= 0x80 || byte == std::char_traits<char>::eof() || !file.read(&current[0], current.size()))
+			throw std::runtime_error("Element file " + path + " is corrupt.");
+		return true;
+	}
+
+	element_t current;
+
+private:
+	std::string const path;
+	std::ifstream file;
+};
+
+/** \brief Reads whole file of length-prefixed elements into set, element by element (so the file is never in memory as a whole). */
+set_t elements_file_to_set(std::string const& path)
+{
+	set_t result(input_opts.element_comp);
+	ElementFileReader reader(path);
+	while (reader.next())
+		result.insert(std::move(reader.current));
 	return result;
 }
 
+/**
+\brief Saves progress of combining inputs in a directory, so that an interrupted run can be resumed
+\details Progress is saved after completed inputs (not within an input), at most once per interval.
+	The directory contains file "setop-checkpoint.state" with format version, fingerprint of inputs and options, number of
+	completed inputs, and name of file with resulting set so far (length-prefixed elements). Each set file gets a new name and
+	state is replaced by renaming, both written to disk before, so that an interruption while saving (also a crash of the system)
+	never leaves an inconsistent checkpoint. A run that does not resume removes all checkpoint files of earlier runs first;
+	all their names begin with CHECKPOINT_PREFIX, other files in the directory are left alone.
+*/
+class Checkpoint
+{
+public:
+	/**
+	\param directory existing directory for checkpoint files
+	\param fingerprint description of inputs and options, a checkpoint is only resumed with the same
+	\param interval minimal number of seconds between two saves
+	\param resuming if saved progress is used by resume
+	*/
+	Checkpoint(std::string const& directory, std::string const& fingerprint, unsigned interval, bool resuming) :
+		directory(directory), fingerprint(std::to_string(partition_hash(fingerprint))), interval(interval), resuming(resuming),
+		last_save(std::chrono::steady_clock::now())
+	{
+		// set files are named set followed by number of completed inputs (see save)
+		auto checkpoint_file = [](std::string const& name)
+		{
+			std::size_t const prefix = std::strlen(CHECKPOINT_PREFIX);
+			if (name.compare(0, prefix, CHECKPOINT_PREFIX) != 0)
+				return false;
+			return name.compare(prefix, std::string::npos, "state") == 0 || name.compare(prefix, std::string::npos, "state.new") == 0 ||
+				(name.size() > prefix + 3 && name.compare(prefix, 3, "set") == 0 && name.find_first_not_of("0123456789", prefix + 3) == std::string::npos);
+		};
+		if (!resuming)
+			for (std::string const& name : directory_entries(directory))
+				if (checkpoint_file(name))
+					std::remove((directory + "/" + name).c_str());
+	}
+
+	/**
+	\brief Loads saved set if resuming.
+	\return number of completed inputs, 0 if not resuming
+	\throws std::runtime_error if there is no usable checkpoint
+	*/
+	std::size_t resume(set_t& output_set)
+	{
+		if (!resuming)
+			return 0;
+		std::ifstream state(path("state"));
+		std::string version, saved_fingerprint;
+		std::size_t completed;
+		if (!(state >> version >> saved_fingerprint >> completed >> set_filename) || version != CHECKPOINT_VERSION)
+			throw std::runtime_error("No valid checkpoint found in " + directory + ".");
+		if (saved_fingerprint != fingerprint)
+			throw std::runtime_error("Checkpoint in " + directory + " was saved with other inputs or options.");
+		output_set = elements_file_to_set(path(set_filename));
+		return completed;
+	}
+
+	/**
+	\brief Saves set after completed inputs, if last save is long enough ago.
+	\throws std::runtime_error
+	*/
+	void save(std::size_t completed, set_t const& output_set)
+	{
+		if (std::chrono::steady_clock::now() - last_save < std::chrono::seconds(interval))
+			return;
+
+		std::string const new_set_filename = "set" + std::to_string(completed);
+		OutputWriter writer(open_output_file(path(new_set_filename)), OutputMethod{ false, 1, false });
+		OutputBuffer block;
+		for (element_t const& el : output_set)
+		{
+			append_varint(block, el.size());
+			block.insert(block.end(), el.begin(), el.end());
+			if (block.size() >= FORMAT_BLOCKSIZE)
+			{
+				writer.append_buffer(std::move(block));
+				block = OutputBuffer();
+			}
+		}
+		writer.append_buffer(std::move(block));
+		writer.finish();
+		sync_to_disk(path(new_set_filename));
+
+		{
+			std::ofstream state(path("state.new"), std::ios::trunc);
+			state << CHECKPOINT_VERSION << "\n" << fingerprint << "\n" << completed << "\n" << new_set_filename << "\n";
+			if (!state.flush())
+				throw std::runtime_error("Checkpoint could not be saved in " + directory + ".");
+		}
+		sync_to_disk(path("state.new"));
+		if (std::rename(path("state.new").c_str(), path("state").c_str()) != 0)
+			throw std::runtime_error("Checkpoint could not be saved in " + directory + ".");
+		sync_to_disk(directory);
+		if (!set_filename.empty() && set_filename != new_set_filename)
+			std::remove(path(set_filename).c_str());
+		set_filename = new_set_filename;
+		last_save = std::chrono::steady_clock::now();
+	}
+
+	/** \brief Removes checkpoint files, e. g. after all inputs are combined. */
+	void remove()
+	{
+		std::remove(path("state").c_str());
+		if (!set_filename.empty())
+			std::remove(path(set_filename).c_str());
+	}
+
+private:
+	/** \brief Returns path of checkpoint file with given name (without CHECKPOINT_PREFIX). */
+	std::string path(std::string const& name) const
+	{
+		return directory + "/" CHECKPOINT_PREFIX + name;
+	}
+
+	std::string const directory;
+	std::string const fingerprint;
+	unsigned const interval;
+	bool const resuming;
+	std::string set_filename; ///< name of last saved (or resumed) set file
+	std::chrono::steady_clock::time_point last_save;
+};
+
+/**
+\brief Executes all set operations in memory: combines all inputs, then subtracts all differences.
+\param checkpoint if not null, progress is saved there after completed inputs, and resumed from there if desired
+\param[out] footprint estimated memory of resulting set (see element_footprint)
+\throws MemoryLimitExceeded if estimated memory exceeds limit given by input options
+*/
+set_t combine_inputs(std::vector<std::string> const& input_filenames, std::vector<std::string> const& setdifference_filenames,
+	SetConcat set_concat_type, Checkpoint* checkpoint, std::size_t& footprint)
+{
+	set_t output_set(input_opts.element_comp);
+	// inputs are counted from first commutative input to last difference
+	std::size_t const completed = (checkpoint ? checkpoint->resume(output_set) : 0);
+	// estimated memory is kept up to date by each step instead of summing it up for each input
+	footprint = set_footprint(output_set);
+
+	// STEP 1/3: execute all commutative set operations (union, intersection, symmetric difference)
+
+	for (std::size_t input = completed; input < input_filenames.size(); ++input)
+	{
+		std::size_t curr_footprint;
+		set_t curr_set = file_to_set(input_filenames[input], memory_left(footprint), &curr_footprint);
+
+		if (input == 0) // if it is the first input stream
+		{
+			output_set = std::move(curr_set);
+			footprint = curr_footprint;
+		}
+		else
+		{
+			combine_sets(output_set, std::move(curr_set), set_concat_type, &footprint);
+		}
+		if (checkpoint)
+			checkpoint->save(input + 1, output_set);
+	}
+
+
+	// STEP 2/3: execute all set differences, that is erase all desired elements from current output set
+
+	for (std::size_t input = std::max(completed, input_filenames.size()); input < input_filenames.size() + setdifference_filenames.size(); ++input)
+	{
+		set_t curr_diff = file_to_set(setdifference_filenames[input - input_filenames.size()], memory_left(footprint));
+		filter_set(output_set, curr_diff, false, &footprint);
+		if (checkpoint)
+			checkpoint->save(input + 1, output_set);
+	}
+
+	return output_set;
+}
+
+/**
+\brief Parses input and distributes its elements into bucket files by hash value, keeping their order.
+\param filename input to parse
+\param paths one file per bucket
+\param ignore_case elements differing in case only must get into same bucket
+\param[in,out] footprints estimated memory of elements in each bucket, increased by elements of this input
+\param buffersize size of buffer for each bucket, written to its file when full
+*/
+void file_to_buckets(std::string const& filename, std::vector<std::string> const& paths, bool ignore_case, std::vector<std::size_t>& footprints,
+	std::size_t buffersize)
+{
+	std::size_t const buckets = paths.size();
+	std::vector<std::unique_ptr<OutputSink>> sinks;
+	std::vector<OutputBuffer> buffers(buckets);
+	for (std::size_t bucket = 0; bucket < buckets; ++bucket)
+	{
+		sinks.push_back(open_output_file(paths[bucket]));
+		buffers[bucket].reserve(buffersize);
+	}
+	auto flush = [&sinks, &buffers](std::size_t bucket)
+	{
+		OutputBlock const block = { buffers[bucket].data(), buffers[bucket].size() };
+		sinks[bucket]->write(&block, 1);
+		buffers[bucket].clear();
+	};
+
+	element_t el; // reused for each element
+	parse_input(filename, [&](char const* first, char const* last)
+	{
+		el.assign(first, last);
+		std::size_t const bucket = partition_hash(ignore_case ? boost::to_upper_copy(el, std::locale()) : el) % buckets;
+		append_varint(buffers[bucket], el.size());
+		buffers[bucket].insert(buffers[bucket].end(), el.begin(), el.end());
+		footprints[bucket] += element_footprint(el);
+		if (buffers[bucket].size() >= buffersize)
+			flush(bucket);
+	});
+
+	for (std::size_t bucket = 0; bucket < buckets; ++bucket)
+	{
+		flush(bucket);
+		sinks[bucket]->finish();
+	}
+}
+
+/** \brief Returns maximal number of buckets: MAX_BUCKETS, but fewer if this process may not open enough files for them. */
+unsigned max_buckets()
+{
+	std::size_t const files = open_files_limit();
+	if (files == 0)
+		return MAX_BUCKETS;
+	return static_cast<unsigned>(std::min<std::size_t>(MAX_BUCKETS, files > BUCKET_FILES_RESERVE ? files - BUCKET_FILES_RESERVE : 1));
+}
+
+/**
+\brief Executes set operations on inputs too large for memory by partitioning them into buckets (grace hash join).
+\details Each input is parsed once, its elements are distributed into bucket files in a temporary directory by hash value,
+	so that equal elements of all inputs get into the same bucket. After that the buckets are processed independently and in parallel
+	(by up to threads threads), each one in memory like the whole inputs otherwise. Finally the sorted results of all buckets are merged.
+	Only one bucket per thread needs to fit into memory; with a memory limit, fewer buckets are processed at once
+	if their estimated memory (all their elements from all inputs) would exceed it. While partitioning, the write buffers
+	of all buckets are made small enough to fit into the memory limit.
+	With processes, buckets are processed by that many child processes instead of threads (bucket i by process i mod processes),
+	each one writing its sorted results and their sizes to files; the memory limit applies to each process then.
+	Only processing the buckets is done by them, the inputs are parsed and partitioned by this process before.
+\param write_set whether resulting set is written (as desired by output options) or only counted
+\return number of elements of resulting set
+\throws std::runtime_error, especially MemoryLimitExceeded if one bucket alone exceeds memory limit
+*/
+std::size_t execute_in_buckets(std::vector<std::string> const& input_filenames, std::vector<std::string> const& setdifference_filenames,
+	SetConcat set_concat_type, bool ignore_case, bool write_set, unsigned buckets, std::string const& temp_dir_parent, unsigned threads,
+	unsigned processes)
+{
+	TemporaryDirectory temp_dir(temp_dir_parent);
+
+	// first all commutative inputs, then all differences
+	std::vector<std::string> filenames(input_filenames);
+	filenames.insert(filenames.end(), setdifference_filenames.begin(), setdifference_filenames.end());
+	std::vector<std::vector<std::string>> bucket_paths(filenames.size());
+	std::vector<std::string> result_paths;
+	for (unsigned bucket = 0; bucket < buckets; ++bucket)
+	{
+		for (std::size_t input = 0; input < filenames.size(); ++input)
+			bucket_paths[input].push_back(temp_dir.file("in" + std::to_string(input) + "_" + std::to_string(bucket)));
+		result_paths.push_back(temp_dir.file("out" + std::to_string(bucket)));
+	}
+
+	// buffers of all buckets are in memory at once while partitioning an input
+	std::size_t bucket_buffersize = BUCKET_BUFFERSIZE;
+	if (input_opts.max_memory > 0)
+	{
+		bucket_buffersize = std::min<std::size_t>(BUCKET_BUFFERSIZE, input_opts.max_memory / buckets);
+		if (bucket_buffersize < BUCKET_MIN_BUFFERSIZE)
+		{
+			if (buckets > 1)
+				throw MemoryLimitExceeded("Buffers of " + std::to_string(buckets) + " buckets exceed the memory limit; use fewer buckets.");
+			bucket_buffersize = BUCKET_MIN_BUFFERSIZE;
+		}
+	}
+	std::vector<std::size_t> footprints(buckets);
+	for (std::size_t input = 0; input < filenames.size(); ++input)
+		file_to_buckets(filenames[input], bucket_paths[input], ignore_case, footprints, bucket_buffersize);
+	for (unsigned bucket = 0; bucket < buckets; ++bucket)
+		if (input_opts.max_memory > 0 && footprints[bucket] > input_opts.max_memory)
+			throw MemoryLimitExceeded("Bucket " + std::to_string(bucket) + " needs about " + std::to_string(footprints[bucket] >> 20) +
+				" MiB, which exceeds the memory limit; use more buckets.");
+
+	std::vector<std::size_t> counts(buckets);
+	std::atomic<unsigned> next_bucket(0);
+	MemoryBudget budget(input_opts.max_memory);
+	auto process_bucket = [&](unsigned bucket)
+	{
+		budget.acquire(footprints[bucket]);
+		// memory is given back in any case, also when processing throws an exception
+		struct BudgetGuard
+		{
+			MemoryBudget& budget;
+			std::size_t bytes;
+			~BudgetGuard() { budget.release(bytes); }
+		} budget_guard = { budget, footprints[bucket] };
+
+		set_t output_set = elements_file_to_set(bucket_paths[0][bucket]);
+		for (std::size_t input = 1; input < filenames.size(); ++input)
+		{
+			if (input < input_filenames.size())
+				combine_sets(output_set, elements_file_to_set(bucket_paths[input][bucket]), set_concat_type);
+			else
+				filter_set(output_set, elements_file_to_set(bucket_paths[input][bucket]), false);
+		}
+		for (std::size_t input = 0; input < filenames.size(); ++input)
+			std::remove(bucket_paths[input][bucket].c_str());
+
+		counts[bucket] = output_set.size();
+		if (write_set)
+		{
+			OutputWriter writer(open_output_file(result_paths[bucket]), OutputMethod{ false, 1, false });
+			OutputBuffer block;
+			for (element_t const& el : output_set)
+			{
+				append_varint(block, el.size());
+				block.insert(block.end(), el.begin(), el.end());
+			}
+			writer.append_buffer(std::move(block));
+			writer.finish();
+		}
+	};
+	if (processes == 0)
+	{
+		auto process_next_buckets = [&]()
+		{
+			for (unsigned bucket; (bucket = next_bucket++) < buckets; )
+				process_bucket(bucket);
+		};
+		std::vector<std::future<void>> other_workers;
+		for (unsigned i = 1; i < std::min(threads, buckets); ++i)
+			other_workers.push_back(std::async(std::launch::async, process_next_buckets));
+		process_next_buckets();
+		for (std::future<void>& worker : other_workers)
+			worker.get();
+	}
+	else
+	{
+		// sizes of bucket results are passed back to this process in files
+		std::vector<std::string> count_paths;
+		for (unsigned worker = 0; worker < processes; ++worker)
+			count_paths.push_back(temp_dir.file("count" + std::to_string(worker)));
+		auto describe_worker = [buckets, processes](unsigned worker)
+		{
+			std::string description = "buckets " + std::to_string(worker);
+			if (worker + processes < buckets)
+				description += ", " + std::to_string(worker + processes) + ", ...";
+			return description + " of " + std::to_string(buckets);
+		};
+		run_in_processes(processes, describe_worker, [&](unsigned worker)
+		{
+			std::ofstream count_file(count_paths[worker], std::ios::trunc);
+			for (unsigned bucket = worker; bucket < buckets; bucket += processes)
+			{
+				process_bucket(bucket);
+				count_file << counts[bucket] << "\n";
+			}
+			if (!count_file.flush())
+				throw std::runtime_error("Temporary file " + count_paths[worker] + " could not be written.");
+		});
+		for (unsigned worker = 0; worker < processes; ++worker)
+		{
+			std::ifstream count_file(count_paths[worker]);
+			for (unsigned bucket = worker; bucket < buckets; bucket += processes)
+				if (!(count_file >> counts[bucket]))
+					throw std::runtime_error("Temporary file " + count_paths[worker] + " could not be read.");
+		}
+	}
+
+	std::size_t count = 0;
+	for (std::size_t bucket_count : counts)
+		count += bucket_count;
+	if (!write_set)
+		return count;
+
+	// merge sorted buckets, elements are unique across buckets
+	std::vector<std::unique_ptr<ElementFileReader>> readers;
+	auto greater = [&readers](std::size_t lhs, std::size_t rhs)
+	{
+		return input_opts.element_comp(readers[rhs]->current, readers[lhs]->current);
+	};
+	std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(greater)> heads(greater);
+	for (unsigned bucket = 0; bucket < buckets; ++bucket)
+	{
+		readers.emplace_back(new ElementFileReader(result_paths[bucket]));
+		if (readers.back()->next())
+			heads.push(bucket);
+	}
+
+	OutputWriter writer(open_compressed_output(open_standard_output(output_opts.output_method.zero_copy),
+		output_opts.compression, output_opts.compression_level, output_opts.compression_threads), output_opts.output_method);
+	write_binary_header(writer, count, ignore_case);
+	OutputBuffer block;
+	block.reserve(2 * FORMAT_BLOCKSIZE);
+	while (!heads.empty())
+	{
+		std::size_t const bucket = heads.top();
+		heads.pop();
+		format_element(block, readers[bucket]->current);
+		if (block.size() >= FORMAT_BLOCKSIZE)
+		{
+			writer.append_buffer(std::move(block));
+			block = OutputBuffer();
+			block.reserve(2 * FORMAT_BLOCKSIZE);
+		}
+		if (readers[bucket]->next())
+			heads.push(bucket);
+	}
+	writer.append_buffer(std::move(block));
+	writer.finish();
+	return count;
+}
+
 /**
 \brief Prints complete error message to console (std::cerr) including hint, that this is an error.
 \param error_message error message without new line at end
@@ -285,10 +1445,11 @@ inline int print_error(std::string const& error_message)
 int execute_setop(int argc, char* argv[])
 {
 	// needed variables, mainly options and arguments from command line
-	bool quiet, verbose, ignore_case;
+	bool quiet, verbose, ignore_case, resume;
+	unsigned threads, buckets, workers, checkpoint_interval;
 	element_t element_to_check;
-	std::string subset_filename, superset_filename, equal_filename, element_format, separator_format;
-	std::vector<std::string> input_filenames, setdifference_filenames;
+	std::string subset_filename, superset_filename, equal_filename, element_format, separator_format, compression_format, output_format, temp_dir, checkpoint_dir, regex_engine;
+	std::vector<std::string> input_filenames, setdifference_filenames, partition_output;
 
 
 	// PARSE COMMAND LINE
@@ -307,8 +1468,55 @@ int execute_setop(int argc, char* argv[])
 		("input-separator,n", po::value(&separator_format), "describe the form of an input separator as regular expression in ECMAScript syntax; "
 			"default is new line (if --input-element is not given); don’t forget to include the new line character \\n when you set the input separator manually, when desired!")
 		("input-element,l", po::value(&element_format), "describe the form of input elements as regular expression in ECMAScript syntax")
+		("regex-engine", po::value(&regex_engine)->default_value("auto"), "engine for finding input separators or elements: "
+			"dfa (linear time, for regular expressions without anchors, word boundaries, back references, and lookarounds), "
+			"boost (backtracking, misses matches at end of input behind a match that would need more input), "
+			"pcre2 (JIT-compiled Perl-compatible regular expressions that must not match the empty string, if supported by this build), "
+			"or auto (dfa if possible, otherwise boost)")
 		("output-separator,o", po::value(&input_opts.output_separator)->default_value("\\n"), "string for separating output elements; escape sequences are allowed")
 		("trim,t", po::value(&input_opts.trim_characters), "trim all given characters at beginning and end of elements (escape sequences allowed)")
+		("output-escape", po::bool_switch(&output_opts.escape_elements)->default_value(false), "write backslashes and whitespace control characters (like new lines) "
+			"in output elements as escape sequences (like \\\\ and \\n)")
+		("output-format", po::value(&output_format)->default_value("text"), "text: elements separated by output separator; "
+			"binary: each element preceded by its length as varint (LEB128), so elements may contain any byte "
+			"(not together with --output-separator or --output-escape)")
+		("output-header", po::bool_switch(&output_opts.binary_header)->default_value(false), "start binary output with header: "
+			"\"" BINARY_MAGIC "\", version byte, flags (varint; 1 = case-insensitive), and number of elements (varint)")
+		("output-thread", po::bool_switch(&output_opts.output_method.threaded)->default_value(false), "write output in separate thread")
+		("output-compress", po::value(&compression_format), "compress output with gzip or zstd (if supported by this build)")
+		("output-compress-level", po::value(&output_opts.compression_level)->default_value(COMPRESSION_LEVEL_DEFAULT, "default of format"),
+			"compression level: 0 to 9 for gzip; for zstd up to 22, and negative levels for faster compression")
+		("output-compress-threads", po::value(&output_opts.compression_threads), "maximal number of threads for compressing output; default is value of --threads")
+		("partition-output", new TwoTokenValue(&partition_output), "arg: N PREFIX; write set into N files PREFIX00000, PREFIX00001, etc. "
+			"(with extension .gz or .zst when compressed) in parallel instead of standard output")
+		("partition-by", po::value<std::string>()->default_value("hash"), "how elements are assigned to partitions: by hash value of element (hash) "
+			"or as contiguous ranges of sorted set with equal number of elements (range)")
+		("zero-copy", po::bool_switch(&output_opts.output_method.zero_copy)->default_value(false), "when standard output is a pipe, "
+			"pass output to it without copying (Linux vmsplice); don’t use it when the reading process splices the data further (e. g. with tee)")
+		("pipeline", po::bool_switch(&input_opts.input_method.pipelined)->default_value(false), "read, parse, and insert input elements in separate threads; "
+			"speeds up slow inputs like network file systems")
+		("io-uring", po::bool_switch(&input_opts.input_method.io_uring)->default_value(false), "read input files with many asynchronous requests at once (Linux io_uring); "
+			"speeds up fast storage like NVMe drives, ignored when not supported")
+		("direct-io", po::bool_switch(&input_opts.input_method.direct_io)->default_value(false), "read input files bypassing the page cache (O_DIRECT), "
+			"so that scanning huge files does not evict cached data of other programs")
+		("max-memory", po::value<std::string>(), "limit (estimated) memory for sets of elements, e. g. 512M or 4G; "
+			"when it is reached, setop continues with --buckets if inputs can be read again, otherwise it fails")
+		("buckets", po::value(&buckets)->default_value(0), "partition all inputs by hash value into this number of temporary files (buckets) "
+			"and process the buckets one by one (in parallel with --threads); for inputs too large for memory, only one bucket per thread must fit into it; "
+			"only for outputting the set, -#, and --is-empty")
+		("workers", po::value(&workers)->default_value(0), ("like --buckets, but process buckets in this number of separate worker processes "
+			"(each one handling every n-th bucket, one bucket per process if --buckets is not given) instead of threads; "
+			"only processing the buckets is parallel, parsing and partitioning the inputs is done before by the main process; "
+			"--max-memory applies to each process; at most " + std::to_string(WORKERS_PER_PROCESSOR) + " per processor").c_str())
+		("temp-dir", po::value(&temp_dir)->default_value(std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp"), "directory for temporary files of --buckets")
+		("checkpoint", po::value(&checkpoint_dir), "save progress (set of all inputs read so far) in this existing directory "
+			"after completed inputs, so that an interrupted run can be continued with --resume; all files written there begin with " CHECKPOINT_PREFIX
+			", inputs must not be standard input")
+		("checkpoint-interval", po::value(&checkpoint_interval)->default_value(300), "minimal number of seconds between saving progress")
+		("resume", po::bool_switch(&resume)->default_value(false), "continue from progress saved in directory of --checkpoint; "
+			"inputs and options must be the same as in the interrupted run")
+		("threads", po::value(&threads)->default_value(std::max(std::thread::hardware_concurrency(), 1u)),
+			"maximal number of threads used for parallel work like decompressing or tokenizing input or formatting output; default is number of processors")
 
 		("union,u", "unite all given input sets (default)")
 		("intersection,i", "unite all given input sets")
@@ -349,13 +1557,14 @@ int execute_setop(int argc, char* argv[])
 			"and print resulting set (sorted and with unique string elements) to standard output or give answer to special queries like number of elements.\n\n"
 
 			"Usage: "
-			PROGRAM_NAME " [-h] [--quiet | --verbose] [-C] [--include-empty] [-n insepar | -l elregex] [-o outsepar] [-t trimchars] "
+			PROGRAM_NAME " [-h] [--quiet | --verbose] [-C] [--include-empty] [-n insepar | -l elregex] [--regex-engine name] [-o outsepar] [--output-escape | --output-format text|binary [--output-header]] [-t trimchars] [--output-compress format [--output-compress-level n] [--output-compress-threads n]] [--partition-output N prefix [--partition-by hash|range]] [--output-thread] [--zero-copy] [--pipeline] [--io-uring] [--direct-io] [--threads n] [--max-memory size] [--buckets n] [--workers n] [--temp-dir dir] [--checkpoint dir [--checkpoint-interval s] [--resume]] "
 			"[-u|i|s] [inputfilename]* [-d filename]* "
 			"[-# | --is-empty | -c element | -e filename | -b filename | -p filename]\n\n"
 
 			<< visible_options
 
-			<< "No input filename or \"-\" is equal to reading from standard input.\n\n"
+			<< "No input filename or \"-\" is equal to reading from standard input. "
+			"Inputs compressed with gzip, zstd, or xz are recognized and decompressed automatically (if supported by this build, otherwise they are read as they are).\n\n"
 
 			<< "\nThe sequence of events of " PROGRAM_NAME " is as follows:\n"
 			"At first, all input files are parsed and combined according to one of the options -u, -i, or -s. "
@@ -368,7 +1577,9 @@ int execute_setop(int argc, char* argv[])
 			"and after that filtered by the desired input element form. "
 			"After finding the elements they are finally trimmed according to the argument given with --trim.\n"
 			"The option -C lets you treat Word and WORD equal, only the first occurrence of all input streams is considered. "
-			"Note that -C does not affect the regular expressions used in --input-separator and --input-element.\n\n"
+			"Note that -C does not affect the regular expressions used in --input-separator and --input-element. "
+			"By default, regular expressions without anchors, word boundaries, back references, and lookarounds that cannot match the empty string "
+			"are matched in linear time, all others by a backtracking engine which can be slow for some expressions (see --regex-engine).\n\n"
 
 			"When describing strings and characters for the output separator or for the option --trim you can use escape sequences like "  R"(\t, \n, \" and \'. )"
 			"But be aware that some of these sequences "  R"((especially \\ and \"))"  " might be interpreted by your shell before passing the string to "
@@ -428,6 +1639,93 @@ int execute_setop(int argc, char* argv[])
 		opt_map.count("equal") ? SetQuery::SET_EQUALITY :
 		SetQuery::RETURN_SET;
 
+	if (threads == 0)
+		threads = 1;
+	input_opts.input_method.threads = output_opts.output_method.threads = threads;
+	if (!opt_map.count("output-compress-threads") || output_opts.compression_threads == 0)
+		output_opts.compression_threads = threads;
+
+	try
+	{
+		output_opts.compression = (compression_format.empty() ? Compression::NONE : compression_from_name(compression_format));
+		check_output_compression(output_opts.compression, output_opts.compression_level);
+	}
+	catch (std::invalid_argument const& e)
+	{
+		return print_error(e.what());
+	}
+
+	if (output_format != "text" && output_format != "binary")
+		return print_error("Output format \"" + output_format + "\" is unknown, use text or binary.");
+	output_opts.binary = (output_format == "binary");
+	if (output_opts.binary && output_opts.escape_elements)
+		return print_error("Option output-escape cannot be used with binary output format.");
+	if (output_opts.binary && !opt_map["output-separator"].defaulted())
+		return print_error("Option output-separator cannot be used with binary output format.");
+	if (output_opts.binary_header && !output_opts.binary)
+		return print_error("Option output-header can only be used with binary output format.");
+
+	output_opts.partitions = 0;
+	if (!partition_output.empty())
+	{
+		if (set_query_type != SetQuery::RETURN_SET)
+			return print_error("Option partition-output can only be used when the set itself is output.");
+		try
+		{
+			std::size_t parsed_chars;
+			unsigned long const partitions = std::stoul(partition_output[0], &parsed_chars);
+			if (parsed_chars != partition_output[0].size() || partitions == 0 || partitions > 100000)
+				throw std::invalid_argument(partition_output[0]);
+			output_opts.partitions = static_cast<unsigned>(partitions);
+		}
+		catch (std::logic_error const&)
+		{
+			return print_error("\"" + partition_output[0] + "\" is no valid number of partitions (1 to 100000).");
+		}
+		output_opts.partition_prefix = partition_output[1];
+	}
+	input_opts.max_memory = 0;
+	if (opt_map.count("max-memory"))
+	{
+		try
+		{
+			input_opts.max_memory = parse_size(opt_map["max-memory"].as<std::string>());
+		}
+		catch (std::invalid_argument const& e)
+		{
+			return print_error(e.what());
+		}
+	}
+
+	unsigned const max_workers = WORKERS_PER_PROCESSOR * std::max(std::thread::hardware_concurrency(), 1u);
+	if (workers > max_workers)
+	{
+		if (!quiet)
+			std::cerr << "Warning: At most " << max_workers << " workers are allowed (" << WORKERS_PER_PROCESSOR << " per processor). Continuing with " << max_workers << " workers.\n";
+		workers = max_workers;
+	}
+	if (workers > buckets)
+		buckets = workers;
+	if (buckets > 0)
+	{
+		if (buckets > max_buckets())
+			return print_error("At most " + std::to_string(max_buckets()) + " buckets are allowed (limited by the number of files that may be open at once).");
+		if (set_query_type != SetQuery::RETURN_SET && set_query_type != SetQuery::CARDINALITY && set_query_type != SetQuery::ISEMPTY)
+			return print_error("Option buckets can only be used when the set itself, its number of elements, or if it is empty is output.");
+		if (output_opts.partitions > 0)
+			return print_error("Options buckets and partition-output cannot be used together.");
+	}
+	if (resume && checkpoint_dir.empty())
+		return print_error("Option resume needs option checkpoint.");
+	if (buckets > 0 && !checkpoint_dir.empty())
+		return print_error("Options buckets and checkpoint cannot be used together.");
+	std::string const& partition_by = opt_map["partition-by"].as<std::string>();
+	if (partition_by != "hash" && partition_by != "range")
+		return print_error("Partitioning by \"" + partition_by + "\" is unknown, use hash or range.");
+	if (!opt_map["partition-by"].defaulted() && output_opts.partitions == 0)
+		return print_error("Option partition-by needs option partition-output.");
+	output_opts.partition_by_range = (partition_by == "range");
+
 	// parse escape sequences of trim characters and output separator to "real" characters (e. g. ".\'\\" gets ".'\")
 	try
 	{
@@ -458,6 +1756,16 @@ int execute_setop(int argc, char* argv[])
 	{
 		return print_error("\"" + (error_in_element_regex ? element_format : separator_format) + "\" is not a valid regular expression.");
 	}
+	// by default parse in linear time if possible, Boost.Regex only for anchors, back references, lookarounds etc.
+	try
+	{
+		input_opts.input_engine = create_regex_engine(element_format.empty() ? separator_format : element_format,
+			regex_engine_from_name(regex_engine));
+	}
+	catch (std::exception const& e)
+	{
+		return print_error(e.what());
+	}
 
 	// handle case-insensitive
 	if (ignore_case)
@@ -470,64 +1778,14 @@ int execute_setop(int argc, char* argv[])
 	// use console as input when no file given
 	if (input_filenames.empty())
 		input_filenames.push_back("-");
+	// a resumed run could not tell if standard input is the same as before
+	if (!checkpoint_dir.empty() && (std::count(input_filenames.begin(), input_filenames.end(), "-") ||
+		std::count(setdifference_filenames.begin(), setdifference_filenames.end(), "-")))
+		return print_error("Option checkpoint cannot be used with standard input as input.");
 
 
 	// PROCESS CALCULATIONS IN THREE STEPS
 
-	// STEP 1/3: execute all commutative set operations (union, intersection, symmetric difference)
-
-	set_t output_set(input_opts.element_comp);
-	for (auto curr_fn_it = input_filenames.cbegin(); curr_fn_it != input_filenames.cend(); ++curr_fn_it)
-	{
-		set_t curr_set = file_to_set(*curr_fn_it);
-
-		if (curr_fn_it == input_filenames.cbegin()) // if it is the first input stream
-		{
-			output_set = std::move(curr_set);
-		}
-		else
-		{
-			switch (set_concat_type)
-			{
-			case SetConcat::UNION:
-				output_set.insert(curr_set.begin(), curr_set.end());
-				break;
-			case SetConcat::INTERSECTION:
-			{
-				set_t intersect(input_opts.element_comp);
-				for (element_t const& el : output_set)
-					if (curr_set.find(el) != curr_set.end())
-						intersect.insert(el);
-
-				output_set = std::move(intersect);
-				break;
-			}
-			case SetConcat::SYM_DIFFERENCE:
-				for (element_t const& el : curr_set)
-				{
-					set_t::const_iterator it = output_set.find(el);
-					if (it != output_set.end())
-						output_set.erase(it);
-					else
-						output_set.insert(el);
-				}
-			}
-		}
-	}
-
-
-	// STEP 2/3: execute all set differences, that is erase all desired elements from current output set
-
-	for (std::string const& filename : setdifference_filenames)
-	{
-		set_t curr_diff = file_to_set(filename);
-		for (element_t const& el : curr_diff)
-			output_set.erase(el);
-	}
-
-
-	// STEP 3/3: calculate output depending on set query
-
 	// print success and failure messages from query and return exit code of program
 	auto answer_query = [quiet, verbose](bool success, std::string success_msg, std::string unsuccess_msg) -> int
 	{
@@ -545,12 +1803,92 @@ int execute_setop(int argc, char* argv[])
 		}
 	};
 
+	// inputs too large for memory: all steps in buckets
+	auto execute_buckets = [&]() -> int
+	{
+		std::size_t const count = execute_in_buckets(input_filenames, setdifference_filenames, set_concat_type, ignore_case,
+			set_query_type == SetQuery::RETURN_SET, buckets, temp_dir, threads, workers);
+		if (set_query_type == SetQuery::CARDINALITY)
+			std::cout << count << "\n";
+		else if (set_query_type == SetQuery::ISEMPTY)
+			return answer_query(count == 0, "Resulting set is empty.\n", "Resulting set is not empty.\n");
+		return EXIT_SUCCESS;
+	};
+	bool const bucketable = (set_query_type == SetQuery::RETURN_SET || set_query_type == SetQuery::CARDINALITY ||
+		set_query_type == SetQuery::ISEMPTY) && output_opts.partitions == 0;
+	if (buckets > 0)
+		return execute_buckets();
+
+	// STEP 1/3 and 2/3: combine all inputs and subtract all differences in memory
+	set_t output_set(input_opts.element_comp);
+	std::size_t output_footprint = 0; // estimated memory of output_set
+	try
+	{
+		std::unique_ptr<Checkpoint> checkpoint;
+		if (!checkpoint_dir.empty())
+		{
+			// everything that influences the set so far must be equal when resuming
+			std::string fingerprint = std::to_string(static_cast<int>(set_concat_type)) + "\n" + std::to_string(ignore_case) + "\n" +
+				std::to_string(input_opts.include_empty_elements) + "\n" + element_format + "\n" + separator_format + "\n" + input_opts.trim_characters + "\n" +
+				regex_engine + "\n";
+			// inputs are identified by name, size, and time of last modification, so a changed input is noticed
+			auto describe_input = [](std::string const& filename)
+			{
+				return filename + "\n" + std::to_string(file_size(filename)) + "\n" + std::to_string(file_modification_time(filename)) + "\n";
+			};
+			for (std::string const& filename : input_filenames)
+				fingerprint += "+" + describe_input(filename);
+			for (std::string const& filename : setdifference_filenames)
+				fingerprint += "-" + describe_input(filename);
+			checkpoint.reset(new Checkpoint(checkpoint_dir, fingerprint, checkpoint_interval, resume));
+		}
+		output_set = combine_inputs(input_filenames, setdifference_filenames, set_concat_type, checkpoint.get(), output_footprint);
+		if (checkpoint)
+			checkpoint->remove();
+	}
+	catch (MemoryLimitExceeded const& exc)
+	{
+		// continue in buckets if inputs can be read again (not standard input) and query can be answered in buckets
+		if (!bucketable || std::count(input_filenames.begin(), input_filenames.end(), "-") ||
+			std::count(setdifference_filenames.begin(), setdifference_filenames.end(), "-"))
+			throw std::runtime_error(std::string(exc.what()) + " Try option buckets or a higher memory limit.");
+
+		unsigned long long input_size = 0;
+		for (std::string const& filename : input_filenames)
+			input_size += file_size(filename);
+		for (std::string const& filename : setdifference_filenames)
+			input_size += file_size(filename);
+		// buffers of all buckets must fit into memory, too (see execute_in_buckets)
+		unsigned long long const most_buckets = std::max<unsigned long long>(1, std::min<unsigned long long>(max_buckets(),
+			input_opts.max_memory / BUCKET_MIN_BUFFERSIZE));
+		buckets = static_cast<unsigned>(std::min<unsigned long long>(most_buckets,
+			std::max<unsigned long long>(2 * threads, 2 * INPUT_MEMORY_RATIO * input_size / input_opts.max_memory + 1)));
+		if (!quiet)
+			std::cerr << "Warning: " << exc.what() << " Continuing with " << buckets << " buckets" <<
+				(checkpoint_dir.empty() ? "" : ", without saving progress in checkpoints") << ".\n";
+		output_set.clear();
+		return execute_buckets();
+	}
+
+
+	// STEP 3/3: calculate output depending on set query
+
 	switch (set_query_type)
 	{
 	case SetQuery::RETURN_SET:
-		for (element_t const& el : output_set)
-			std::cout << el << input_opts.output_separator;
+	{
+		if (output_opts.partitions > 0)
+		{
+			write_partitions(output_set, ignore_case);
+			return EXIT_SUCCESS;
+		}
+		OutputWriter writer(open_compressed_output(open_standard_output(output_opts.output_method.zero_copy),
+			output_opts.compression, output_opts.compression_level, output_opts.compression_threads), output_opts.output_method);
+		write_binary_header(writer, output_set.size(), ignore_case);
+		write_formatted(writer, output_set.begin(), output_set.end(), format_element, output_opts.output_method.threads);
+		writer.finish();
 		return EXIT_SUCCESS;
+	}
 	case SetQuery::CARDINALITY:
 		std::cout << output_set.size() << "\n";
 		return EXIT_SUCCESS;
@@ -567,12 +1905,12 @@ int execute_setop(int argc, char* argv[])
 			"Input does not contain element \"" + element_to_check + "\".\n");
 	case SetQuery::SET_EQUALITY:
 		return answer_query(
-			file_to_set(equal_filename) == output_set,
+			file_to_set(equal_filename, memory_left(output_footprint)) == output_set,
 			"Resulting set is equal to input \"" + equal_filename + "\".\n",
 			"Resulting set is not equal to input \"" + equal_filename + "\".\n");
 	case SetQuery::SUBSET:
 	{
-		set_t set_to_check = file_to_set(subset_filename);
+		set_t set_to_check = file_to_set(subset_filename, memory_left(output_footprint));
 		return answer_query(
 			std::all_of(set_to_check.begin(), set_to_check.end(),
 				[&output_set](element_t const& str) { return output_set.find(str) != output_set.end(); }),
@@ -581,7 +1919,7 @@ int execute_setop(int argc, char* argv[])
 	}
 	case SetQuery::SUPERSET:
 	{
-		set_t set_to_check = file_to_set(superset_filename);
+		set_t set_to_check = file_to_set(superset_filename, memory_left(output_footprint));
 		return answer_query(
 			std::all_of(output_set.begin(), output_set.end(),
 				[&set_to_check](element_t const& str) { return set_to_check.find(str) != set_to_check.end(); }),
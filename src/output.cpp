@@ -0,0 +1,508 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "output.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define SETOP_HAVE_POSIX
+	#include <sys/uio.h>
+	#include <sys/stat.h>
+	#include <sys/ioctl.h>
+	#include <poll.h>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <climits>
+#endif
+
+
+/**
+\brief size of one output buffer
+\details large enough that system calls are rare, small enough to stay in the CPU caches
+*/
+#define OUTPUT_BUFFERSIZE (1 << 20)
+/** \brief number of full buffers that may wait for writer thread */
+#define OUTPUT_BUFFERS 4
+/** \brief desired capacity of pipe at standard output when using vmsplice */
+#define STDOUT_PIPESIZE (1 << 20)
+
+
+OutputWriter::OutputWriter(std::unique_ptr<OutputSink> sink, OutputMethod const& method) :
+	sink(std::move(sink)), threaded(method.threaded), full_buffers(OUTPUT_BUFFERS), free_buffers(OUTPUT_BUFFERS)
+{
+	buffer.reserve(OUTPUT_BUFFERSIZE);
+	if (threaded)
+		writer = std::thread(&OutputWriter::run_writer, this);
+}
+
+OutputWriter::~OutputWriter()
+{
+	full_buffers.close();
+	free_buffers.close();
+	if (writer.joinable())
+		writer.join();
+}
+
+void OutputWriter::run_writer()
+{
+	try
+	{
+		buffer_t curr_buffer;
+		while (full_buffers.pop(curr_buffer))
+		{
+			curr_buffer = sink->write_buffer(std::move(curr_buffer));
+			// when there are enough buffers for reuse, this one is freed
+			if (curr_buffer.capacity() > 0)
+				free_buffers.try_push(std::move(curr_buffer));
+		}
+	}
+	catch (...)
+	{
+		writer_error.store_current();
+		full_buffers.close();
+	}
+}
+
+void OutputWriter::flush_buffer()
+{
+	if (buffer.empty())
+		return;
+	if (!threaded)
+	{
+		buffer = sink->write_buffer(std::move(buffer));
+	}
+	else
+	{
+		if (!full_buffers.push(std::move(buffer)))
+		{
+			writer_error.rethrow();
+			throw std::runtime_error("Writing output was aborted.");
+		}
+		if (!free_buffers.try_pop(buffer))
+			buffer = buffer_t();
+	}
+	buffer.clear();
+	buffer.reserve(OUTPUT_BUFFERSIZE);
+}
+
+void OutputWriter::append_slow(char const* data, std::size_t size)
+{
+	if (size < OUTPUT_BUFFERSIZE / 2)
+	{
+		flush_buffer();
+		buffer.insert(buffer.end(), data, data + size);
+		return;
+	}
+
+	if (threaded)
+	{
+		write_large(buffer_t(data, data + size));
+	}
+	else
+	{
+		// large piece: write it together with buffer instead of copying it
+		OutputBlock const blocks[2] = { { buffer.data(), buffer.size() }, { data, size } };
+		sink->write(blocks, 2);
+		buffer.clear();
+	}
+}
+
+void OutputWriter::append_buffer(buffer_t&& block)
+{
+	if (block.size() < OUTPUT_BUFFERSIZE / 2)
+		append(block.data(), block.size());
+	else
+		write_large(std::move(block));
+}
+
+void OutputWriter::write_large(buffer_t&& block)
+{
+	flush_buffer();
+	if (!threaded)
+	{
+		sink->write_buffer(std::move(block));
+		return;
+	}
+
+	if (!full_buffers.push(std::move(block)))
+	{
+		writer_error.rethrow();
+		throw std::runtime_error("Writing output was aborted.");
+	}
+}
+
+void OutputWriter::finish()
+{
+	flush_buffer();
+	if (threaded)
+	{
+		full_buffers.close();
+		writer.join();
+		writer_error.rethrow();
+	}
+	sink->finish();
+}
+
+
+void append_escaped(OutputBuffer& dest, char const* data, std::size_t size)
+{
+	for (char const* const end = data + size; data != end; ++data)
+	{
+		char escaped;
+		switch (*data)
+		{
+		case '\\': escaped = '\\'; break;
+		case '\f': escaped = 'f'; break;
+		case '\n': escaped = 'n'; break;
+		case '\r': escaped = 'r'; break;
+		case '\t': escaped = 't'; break;
+		case '\v': escaped = 'v'; break;
+		default:
+			dest.push_back(*data);
+			continue;
+		}
+		dest.push_back('\\');
+		dest.push_back(escaped);
+	}
+}
+
+
+#ifdef SETOP_HAVE_POSIX
+
+/** \brief Writes with POSIX writev to a file descriptor */
+class DescriptorSink : public OutputSink
+{
+public:
+	/**
+	\param fd file descriptor to write to
+	\param name name of output for error messages
+	\param owns_fd fd is closed by finish (or by destructor if finish is not called)
+	*/
+	DescriptorSink(int fd, std::string const& name, bool owns_fd) : fd(fd), name(name), owns_fd(owns_fd) {}
+
+	~DescriptorSink() override
+	{
+		if (owns_fd && fd >= 0)
+			close(fd);
+	}
+
+	void finish() override
+	{
+		if (!owns_fd || fd < 0)
+			return;
+		// some file systems (e. g. NFS) report write errors like a full disk only when closing;
+		// fd is closed in any case, also when interrupted (Linux), so close is not repeated
+		int const result = close(fd);
+		fd = -1;
+		if (result != 0 && errno != EINTR)
+			throw std::runtime_error("Writing to " + name + " failed: " + std::strerror(errno));
+	}
+
+	void write(OutputBlock const* blocks, std::size_t count) override
+	{
+		std::vector<iovec> iovecs;
+		for (std::size_t i = 0; i < count; ++i)
+			if (blocks[i].size > 0)
+				iovecs.push_back(iovec{ const_cast<char*>(blocks[i].data), blocks[i].size });
+
+		// writev may write less than desired (e. g. to pipes or when interrupted by signal), so repeat for the rest
+		std::size_t first = 0;
+		while (first < iovecs.size())
+		{
+			int const iov_count = static_cast<int>(std::min<std::size_t>(iovecs.size() - first, IOV_MAX));
+			ssize_t written = writev(fd, iovecs.data() + first, iov_count);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw std::runtime_error("Writing to " + name + " failed: " + std::strerror(errno));
+			}
+			while (first < iovecs.size() && static_cast<std::size_t>(written) >= iovecs[first].iov_len)
+				written -= iovecs[first++].iov_len;
+			if (first < iovecs.size())
+			{
+				iovecs[first].iov_base = static_cast<char*>(iovecs[first].iov_base) + written;
+				iovecs[first].iov_len -= written;
+			}
+		}
+	}
+
+private:
+	int fd; ///< -1 when closed
+	std::string const name;
+	bool const owns_fd;
+};
+
+
+#if defined(__linux__) && defined(SPLICE_F_GIFT)
+
+/**
+\brief Hands pages of output buffers to a pipe with vmsplice instead of copying them
+\details The pipe references the pages until the reader has consumed them, so a buffer must not be changed
+	until that has happened. A buffer is reused only when the bytes still in the pipe (FIONREAD) were all spliced after it;
+	the capacity of the pipe is not relied on, because the reader may enlarge it at any time.
+	At the end, finish waits until the reader has emptied the pipe before the buffers are freed.
+	If output is given up before (exception), the buffers still in the pipe are deliberately leaked,
+	because freeing them would let the allocator (and later allocations) write into pages the reader has not seen yet.
+	This is not safe if the reader does not copy the data, but splices it on (e. g. with tee or splice).
+*/
+class VmspliceSink : public OutputSink
+{
+public:
+	VmspliceSink(int fd, std::string const& name) :
+		fd(fd), name(name), total_spliced(0) {}
+
+	~VmspliceSink() override
+	{
+		if (!retired.empty())
+			new std::deque<std::pair<OutputBuffer, unsigned long long>>(std::move(retired)); // leaked on purpose, see above
+	}
+
+	void finish() override
+	{
+		// buffers can be freed when the reader has emptied the pipe or closed it (its data is not read anymore then)
+		pollfd pipe_fd = { fd, POLLOUT, 0 };
+		int unread;
+		while (true)
+		{
+			if (ioctl(fd, FIONREAD, &unread) != 0)
+				return; // unknown, so buffers are leaked by destructor
+			if (unread == 0 || (poll(&pipe_fd, 1, 0) > 0 && (pipe_fd.revents & POLLERR)))
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		retired.clear();
+	}
+
+	void write(OutputBlock const* blocks, std::size_t count) override
+	{
+		// memory of caller may be changed after returning, so it must be copied
+		OutputBuffer copy;
+		for (std::size_t i = 0; i < count; ++i)
+			copy.insert(copy.end(), blocks[i].data, blocks[i].data + blocks[i].size);
+		write_buffer(std::move(copy));
+	}
+
+	OutputBuffer write_buffer(OutputBuffer&& buffer) override
+	{
+		iovec vec = { buffer.data(), buffer.size() };
+		while (vec.iov_len > 0)
+		{
+			ssize_t const spliced = vmsplice(fd, &vec, 1, 0);
+			if (spliced < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw std::runtime_error("Writing to " + name + " failed: " + std::strerror(errno));
+			}
+			vec.iov_base = static_cast<char*>(vec.iov_base) + spliced;
+			vec.iov_len -= spliced;
+			total_spliced += spliced;
+		}
+		retired.push_back(std::make_pair(std::move(buffer), total_spliced));
+
+		// oldest buffers can be reused when the reader has consumed them, i. e. all bytes still in the pipe were spliced after them
+		OutputBuffer reusable;
+		int unread;
+		if (ioctl(fd, FIONREAD, &unread) != 0 || unread < 0)
+			return reusable;
+		while (!retired.empty() && retired.front().second <= total_spliced - static_cast<unsigned>(unread))
+		{
+			reusable = std::move(retired.front().first);
+			retired.pop_front();
+		}
+		reusable.clear();
+		return reusable;
+	}
+
+private:
+	int const fd;
+	std::string const name;
+	unsigned long long total_spliced; ///< number of bytes spliced so far
+	std::deque<std::pair<OutputBuffer, unsigned long long>> retired; ///< buffers still referenced by pipe, with total_spliced after them
+};
+
+#endif
+
+#endif // SETOP_HAVE_POSIX
+
+
+/** \brief Writes to a std::ostream, used where POSIX is not available */
+class StreamSink : public OutputSink
+{
+public:
+	explicit StreamSink(std::ostream& outputstream) : outputstream(outputstream) {}
+
+	void write(OutputBlock const* blocks, std::size_t count) override
+	{
+		for (std::size_t i = 0; i < count; ++i)
+			outputstream.write(blocks[i].data, blocks[i].size);
+		if (!outputstream)
+			throw std::runtime_error("Writing output failed.");
+	}
+
+	void finish() override
+	{
+		outputstream.flush();
+	}
+
+private:
+	std::ostream& outputstream;
+};
+
+
+/** \brief Writes to a file opened as std::ofstream, used where POSIX is not available */
+class FileStreamSink : public OutputSink
+{
+public:
+	explicit FileStreamSink(std::unique_ptr<std::ofstream> file) : file(std::move(file)), sink(*this->file) {}
+
+	void write(OutputBlock const* blocks, std::size_t count) override
+	{
+		sink.write(blocks, count);
+	}
+
+	void finish() override
+	{
+		sink.finish();
+		file->close();
+		if (!*file)
+			throw std::runtime_error("Writing output file failed.");
+	}
+
+private:
+	std::unique_ptr<std::ofstream> file;
+	StreamSink sink;
+};
+
+
+std::unique_ptr<OutputSink> open_standard_output(bool zero_copy)
+{
+	// make sure that everything written to std::cout so far comes first
+	std::cout.flush();
+#if defined(__linux__) && defined(SPLICE_F_GIFT)
+	struct stat stdout_stat;
+	if (zero_copy && fstat(STDOUT_FILENO, &stdout_stat) == 0 && S_ISFIFO(stdout_stat.st_mode))
+	{
+		if (fcntl(STDOUT_FILENO, F_GETPIPE_SZ) < STDOUT_PIPESIZE)
+			fcntl(STDOUT_FILENO, F_SETPIPE_SZ, STDOUT_PIPESIZE);
+		return std::unique_ptr<OutputSink>(new VmspliceSink(STDOUT_FILENO, "standard output"));
+	}
+#else
+	(void)zero_copy;
+#endif
+#ifdef SETOP_HAVE_POSIX
+	return std::unique_ptr<OutputSink>(new DescriptorSink(STDOUT_FILENO, "standard output", false));
+#else
+	return std::unique_ptr<OutputSink>(new StreamSink(std::cout));
+#endif
+}
+
+std::unique_ptr<OutputSink> open_output_file(std::string const& filename)
+{
+#ifdef SETOP_HAVE_POSIX
+	int const fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0)
+		throw std::runtime_error("Output file " + filename + " could not be opened: " + std::strerror(errno));
+	return std::unique_ptr<OutputSink>(new DescriptorSink(fd, filename, true));
+#else
+	std::unique_ptr<std::ofstream> file(new std::ofstream(filename, std::ios::binary | std::ios::trunc));
+	if (!*file)
+		throw std::runtime_error("Output file " + filename + " could not be opened.");
+	return std::unique_ptr<OutputSink>(new FileStreamSink(std::move(file)));
+#endif
+}
+
+
+TemporaryDirectory::TemporaryDirectory(std::string const& parent)
+{
+#ifdef SETOP_HAVE_POSIX
+	std::string pattern = parent + "/setop-XXXXXX";
+	if (!mkdtemp(&pattern[0]))
+		throw std::runtime_error("Temporary directory in " + parent + " could not be created: " + std::strerror(errno));
+	path = pattern;
+#else
+	throw std::runtime_error("Temporary directories are not supported on this platform.");
+#endif
+}
+
+TemporaryDirectory::~TemporaryDirectory()
+{
+#ifdef SETOP_HAVE_POSIX
+	for (std::string const& name : names)
+		std::remove((path + "/" + name).c_str());
+	rmdir(path.c_str());
+#endif
+}
+
+std::string TemporaryDirectory::file(std::string const& name)
+{
+	names.push_back(name);
+	return path + "/" + name;
+}
+
+void TemporaryDirectory::remove_file(std::string const& name)
+{
+	std::remove((path + "/" + name).c_str());
+}
+
+
+void sync_to_disk(std::string const& path)
+{
+#ifdef SETOP_HAVE_POSIX
+	int const fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0 || fsync(fd) != 0)
+	{
+		std::string const reason = std::strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		throw std::runtime_error(path + " could not be written to disk: " + reason);
+	}
+	close(fd);
+#else
+	(void)path;
+#endif
+}
+
+std::vector<std::string> directory_entries(std::string const& path)
+{
+	std::vector<std::string> names;
+#ifdef SETOP_HAVE_POSIX
+	DIR* const dir = opendir(path.c_str());
+	if (!dir)
+		throw std::runtime_error("Directory " + path + " could not be read: " + std::strerror(errno));
+	while (dirent const* const entry = readdir(dir))
+	{
+		std::string const name = entry->d_name;
+		if (name != "." && name != "..")
+			names.push_back(name);
+	}
+	closedir(dir);
+#else
+	(void)path;
+#endif
+	return names;
+}
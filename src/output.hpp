@@ -0,0 +1,337 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_OUTPUT_HPP
+#define SETOP_OUTPUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <deque>
+#include <future>
+
+#include "pipeline.hpp"
+
+
+/**
+\file
+\brief Buffered output of (many) elements to standard output or files
+*/
+
+
+/**
+\brief Allocator for memory aligned to pages
+\details Page-aligned buffers can be handed to the kernel page by page (vmsplice) instead of being copied.
+*/
+template <typename T>
+struct PageAlignedAllocator
+{
+	typedef T value_type;
+
+	PageAlignedAllocator() = default;
+	template <typename U>
+	PageAlignedAllocator(PageAlignedAllocator<U> const&) {}
+
+	T* allocate(std::size_t n)
+	{
+		void* memory = nullptr;
+		if (posix_memalign(&memory, 4096, n * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T*>(memory);
+	}
+
+	void deallocate(T* p, std::size_t)
+	{
+		std::free(p);
+	}
+
+	template <typename U>
+	bool operator==(PageAlignedAllocator<U> const&) const { return true; }
+	template <typename U>
+	bool operator!=(PageAlignedAllocator<U> const&) const { return false; }
+};
+
+/** \brief buffer with formatted output */
+typedef std::vector<char, PageAlignedAllocator<char>> OutputBuffer;
+
+
+/** \brief piece of memory to be written */
+struct OutputBlock
+{
+	char const* data;
+	std::size_t size;
+};
+
+
+/** \brief Interface for everything output can be written to */
+class OutputSink
+{
+public:
+	virtual ~OutputSink() {}
+
+	/**
+	\brief Writes all given blocks in given order.
+	\throws std::runtime_error
+	*/
+	virtual void write(OutputBlock const* blocks, std::size_t count) = 0;
+
+	/**
+	\brief Writes whole buffer, taking it over.
+	\details Sinks that hand memory to the kernel without copying it (vmsplice) keep the buffer as long as necessary.
+	\return some buffer that may be reused by caller (maybe empty and without capacity)
+	\throws std::runtime_error
+	*/
+	virtual OutputBuffer write_buffer(OutputBuffer&& buffer)
+	{
+		OutputBlock const block = { buffer.data(), buffer.size() };
+		write(&block, 1);
+		buffer.clear();
+		return std::move(buffer);
+	}
+
+	/**
+	\brief Called once after last write, e. g. for writing trailers.
+	\throws std::runtime_error
+	*/
+	virtual void finish() {}
+};
+
+
+/** \brief How output is written */
+struct OutputMethod
+{
+	bool threaded; ///< write in separate thread, so that formatting and writing overlap
+	unsigned threads; ///< maximal number of threads for formatting output in parallel
+	bool zero_copy; ///< hand output pages to pipes without copying them (vmsplice), see open_standard_output
+};
+
+
+/**
+\brief Collects output in large buffers and hands them to a sink
+\details Replaces writing each element to std::cout (which is synchronized with C stdio and does one virtual call per insertion).
+	Elements larger than half of the buffer are passed to the sink directly instead of being copied.
+	When threaded, full buffers are written by a separate thread while the next one is filled.
+*/
+class OutputWriter
+{
+public:
+	/**
+	\param sink destination of output, taken over
+	\param method e. g. write in separate thread
+	*/
+	OutputWriter(std::unique_ptr<OutputSink> sink, OutputMethod const& method);
+	/** \brief Stops writer thread, but does not flush; call finish for that. */
+	~OutputWriter();
+
+	OutputWriter(OutputWriter const&) = delete;
+	OutputWriter& operator=(OutputWriter const&) = delete;
+
+	/** \brief Appends data to output. */
+	void append(char const* data, std::size_t size)
+	{
+		if (size <= buffer.capacity() - buffer.size())
+			buffer.insert(buffer.end(), data, data + size);
+		else
+			append_slow(data, size);
+	}
+
+	void append(std::string const& str)
+	{
+		append(str.data(), str.size());
+	}
+
+	/** \brief Appends whole buffer to output, large buffers are written without copying them. */
+	void append_buffer(OutputBuffer&& block);
+
+	/**
+	\brief Writes all buffered output and finishes sink.
+	\throws std::runtime_error
+	*/
+	void finish();
+
+private:
+	typedef OutputBuffer buffer_t;
+
+	void append_slow(char const* data, std::size_t size);
+	void write_large(buffer_t&& block);
+	void flush_buffer();
+	void run_writer();
+
+	std::unique_ptr<OutputSink> sink;
+	bool const threaded;
+	buffer_t buffer; ///< collects output, capacity is fixed
+	BoundedQueue<buffer_t> full_buffers; ///< buffers to be written by writer thread
+	BoundedQueue<buffer_t> free_buffers; ///< buffers written by writer thread, ready for reuse
+	PipelineError writer_error;
+	std::thread writer;
+};
+
+
+/**
+\brief Appends data to dest with backslash escape sequences for backslash and whitespace control characters
+\details Counterpart of unescape_sequence: \\, \f, \n, \r, \t, \v are written as escape sequences,
+	so that elements containing separators made of these characters (like line breaks or tabs) can be written unambiguously.
+	Other characters (e. g. space or comma) are not escaped, so elements containing such separators stay ambiguous.
+*/
+void append_escaped(OutputBuffer& dest, char const* data, std::size_t size);
+
+/**
+\brief Appends value to dest as variable-length integer (unsigned LEB128)
+\details Seven bits per byte, least significant group first, highest bit set in all bytes but the last.
+*/
+inline void append_varint(OutputBuffer& dest, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		dest.push_back(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	dest.push_back(static_cast<char>(value));
+}
+
+
+/** \brief number of elements formatted by one thread at once in write_formatted */
+#define FORMAT_RANGE_ELEMENTS 65536
+/** \brief size of block handed to OutputWriter when formatting serially in write_formatted */
+#define FORMAT_BLOCKSIZE (1 << 20)
+
+/**
+\brief Formats all elements of a (sorted) range and writes them to writer in order.
+\details The range is split into contiguous parts, which are formatted into separate buffers by up to threads threads at once.
+	The buffers are written strictly in order, so output is identical to formatting serially.
+	A range of a single part (at most FORMAT_RANGE_ELEMENTS elements) is formatted serially, starting threads would cost more than it saves.
+\param writer destination of output
+\param first,last range of elements
+\param format function (OutputBuffer& dest, element) appending formatted element to dest; called concurrently
+\param threads maximal number of threads formatting in parallel
+*/
+template <typename ForwardIt, typename Formatter>
+void write_formatted(OutputWriter& writer, ForwardIt first, ForwardIt last, Formatter const& format, unsigned threads)
+{
+	typedef OutputBuffer block_t;
+	bool serial = (threads <= 1);
+	if (!serial)
+	{
+		ForwardIt probe = first;
+		std::size_t count = 0;
+		for (; probe != last && count <= FORMAT_RANGE_ELEMENTS; ++probe)
+			++count;
+		serial = (count <= FORMAT_RANGE_ELEMENTS);
+	}
+	if (serial)
+	{
+		block_t block;
+		block.reserve(2 * FORMAT_BLOCKSIZE);
+		for (; first != last; ++first)
+		{
+			format(block, *first);
+			if (block.size() >= FORMAT_BLOCKSIZE)
+			{
+				writer.append_buffer(std::move(block));
+				block = block_t();
+				block.reserve(2 * FORMAT_BLOCKSIZE);
+			}
+		}
+		writer.append_buffer(std::move(block));
+		return;
+	}
+
+	// finding the range limits (iterating) is done here, while other threads format previous ranges
+	std::deque<std::future<block_t>> blocks;
+	while (first != last || !blocks.empty())
+	{
+		while (first != last && blocks.size() < threads)
+		{
+			ForwardIt range_end = first;
+			for (std::size_t i = 0; i < FORMAT_RANGE_ELEMENTS && range_end != last; ++i)
+				++range_end;
+			blocks.push_back(std::async(std::launch::async, [&format](ForwardIt range_begin, ForwardIt range_end)
+			{
+				block_t block;
+				for (; range_begin != range_end; ++range_begin)
+					format(block, *range_begin);
+				return block;
+			}, first, range_end));
+			first = range_end;
+		}
+		writer.append_buffer(blocks.front().get());
+		blocks.pop_front();
+	}
+}
+
+
+/**
+\brief Creates sink for standard output.
+\details Uses plain POSIX write if available, std::cout otherwise.
+\param zero_copy when standard output is a pipe, hand pages of output buffers to the pipe with vmsplice (Linux only);
+	only safe if the reading process copies the data (as read does), not if it splices them further
+*/
+std::unique_ptr<OutputSink> open_standard_output(bool zero_copy);
+
+/**
+\brief Creates sink writing to a file, which is created or truncated.
+\throws std::runtime_error if file cannot be opened
+*/
+std::unique_ptr<OutputSink> open_output_file(std::string const& filename);
+
+
+/**
+\brief Directory for temporary files, which is removed together with its files on destruction
+\details Only files whose names were obtained by file are removed.
+*/
+class TemporaryDirectory
+{
+public:
+	/**
+	\brief Creates new directory with unique name.
+	\param parent existing directory the new one is created in, e. g. /tmp
+	\throws std::runtime_error if directory cannot be created (or temporary directories are not supported)
+	*/
+	explicit TemporaryDirectory(std::string const& parent);
+	~TemporaryDirectory();
+
+	TemporaryDirectory(TemporaryDirectory const&) = delete;
+	TemporaryDirectory& operator=(TemporaryDirectory const&) = delete;
+
+	/** \brief Returns path of file with given name inside directory, file is removed on destruction. Not thread-safe. */
+	std::string file(std::string const& name);
+
+	/** \brief Removes file with given name early, e. g. when it is not needed anymore. */
+	void remove_file(std::string const& name);
+
+private:
+	std::string path;
+	std::vector<std::string> names; ///< names of files to be removed
+};
+
+/**
+\brief Makes sure that data of file or directory (e. g. a renaming in it) is written to disk (fsync).
+\details Does nothing if not supported on this platform.
+\throws std::runtime_error
+*/
+void sync_to_disk(std::string const& path);
+
+/**
+\brief Returns names of all files and directories in directory (without . and ..).
+\details Returns nothing if not supported on this platform.
+\throws std::runtime_error
+*/
+std::vector<std::string> directory_entries(std::string const& path);
+
+#endif // SETOP_OUTPUT_HPP
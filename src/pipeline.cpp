@@ -0,0 +1,105 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "pipeline.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define SETOP_HAVE_POSIX
+	#include <sys/types.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+
+void run_in_processes(unsigned count, std::function<std::string(unsigned)> const& describe, std::function<void(unsigned)> const& work)
+{
+#ifdef SETOP_HAVE_POSIX
+	// everything buffered so far must not be written by each child again
+	std::cout.flush();
+	std::cerr.flush();
+
+	std::vector<pid_t> children;
+	std::string error;
+	for (unsigned i = 0; i < count && error.empty(); ++i)
+	{
+		pid_t const child = fork();
+		if (child < 0)
+		{
+			error = std::string("Worker process could not be started: ") + std::strerror(errno);
+		}
+		else if (child == 0)
+		{
+			int exit_code = EXIT_SUCCESS;
+			try
+			{
+				work(i);
+			}
+			catch (std::exception const& exc)
+			{
+				std::cerr << "Error in worker process " << i << ": " << exc.what() << std::endl;
+				exit_code = EXIT_FAILURE;
+			}
+			catch (...)
+			{
+				std::cerr << "Unknown error in worker process " << i << "." << std::endl;
+				exit_code = EXIT_FAILURE;
+			}
+			_exit(exit_code);
+		}
+		else
+		{
+			children.push_back(child);
+		}
+	}
+
+	// wait for all started children, also when starting others failed
+	for (unsigned i = 0; i < children.size(); ++i)
+	{
+		int status;
+		bool waited = true;
+		while (waitpid(children[i], &status, 0) < 0)
+		{
+			if (errno != EINTR)
+			{
+				waited = false;
+				break;
+			}
+		}
+		if (!error.empty() || (waited && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS))
+			continue;
+		error = "Worker process " + std::to_string(i) + " (" + describe(i) + ") ";
+		if (!waited)
+			error += "could not be waited for: " + std::string(std::strerror(errno)) + ".";
+		else if (WIFEXITED(status))
+			error += "failed with exit status " + std::to_string(WEXITSTATUS(status)) + ".";
+		else if (WIFSIGNALED(status))
+			error += "was killed by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ").";
+		else
+			error += "failed.";
+	}
+	if (!error.empty())
+		throw std::runtime_error(error);
+#else
+	(void)count; (void)describe; (void)work;
+	throw std::runtime_error("Worker processes are not supported on this platform.");
+#endif
+}
@@ -0,0 +1,209 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_PIPELINE_HPP
+#define SETOP_PIPELINE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <utility>
+#include <functional>
+#include <string>
+
+
+/**
+\file
+\brief Helpers for running stages of setop (reading, parsing, inserting) in separate threads or processes
+*/
+
+
+/**
+\brief Thread-safe FIFO queue with fixed capacity for handing over work between two pipeline stages
+\details push blocks as long as the queue is full, pop blocks as long as it is empty.
+	After close, push fails and pop returns the remaining items and fails afterwards;
+	this way a stage can tell its neighbour that there is no more work (or that it has given up because of an error).
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+	/** \param capacity maximal number of items waiting in queue, at least 1 */
+	explicit BoundedQueue(std::size_t capacity) : capacity(capacity ? capacity : 1), closed(false) {}
+
+	BoundedQueue(BoundedQueue const&) = delete;
+	BoundedQueue& operator=(BoundedQueue const&) = delete;
+
+	/**
+	\brief Appends item, waits if queue is full.
+	\return false if queue is (or gets) closed, item is dropped then
+	*/
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+		if (closed)
+			return false;
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+		return true;
+	}
+
+	/**
+	\brief Appends item if there is space left, never waits.
+	\return false if queue is full or closed, item is dropped then
+	*/
+	bool try_push(T item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closed || items.size() >= capacity)
+			return false;
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+		return true;
+	}
+
+	/**
+	\brief Takes first item, waits if queue is empty.
+	\return false if queue is closed and empty, item is unchanged then
+	*/
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this] { return closed || !items.empty(); });
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	/** \brief Takes first item if there is one, never waits. */
+	bool try_pop(T& item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	/** \brief No more items are accepted, waiting threads are woken up. */
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+private:
+	std::size_t const capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable not_full, not_empty;
+};
+
+
+/**
+\brief Keeps the first exception thrown in a pipeline thread so that it can be rethrown in the main thread
+\details Threads must not let exceptions escape (std::terminate would be called), so they store them here.
+*/
+class PipelineError
+{
+public:
+	PipelineError() = default;
+	PipelineError(PipelineError const&) = delete;
+	PipelineError& operator=(PipelineError const&) = delete;
+
+	/** \brief Stores current exception, call it only inside a catch block. */
+	void store_current()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!error)
+			error = std::current_exception();
+	}
+
+	/** \brief Rethrows stored exception, if there is one. */
+	void rethrow()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+private:
+	std::exception_ptr error;
+	std::mutex mutex;
+};
+
+/**
+\brief Shares a memory budget between threads working in parallel
+\details Each thread reserves the (estimated) memory it needs before starting its work and releases it afterwards,
+	so that threads wait instead of exceeding the budget together.
+*/
+class MemoryBudget
+{
+public:
+	/** \param total available memory in bytes, 0 for unlimited */
+	explicit MemoryBudget(std::size_t total) : total(total), used(0) {}
+
+	MemoryBudget(MemoryBudget const&) = delete;
+	MemoryBudget& operator=(MemoryBudget const&) = delete;
+
+	/** \brief Waits until bytes (at most total) are available and reserves them. */
+	void acquire(std::size_t bytes)
+	{
+		if (total == 0)
+			return;
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this, bytes] { return used + bytes <= total; });
+		used += bytes;
+	}
+
+	/** \brief Gives back bytes reserved by acquire. */
+	void release(std::size_t bytes)
+	{
+		if (total == 0)
+			return;
+		std::lock_guard<std::mutex> lock(mutex);
+		used -= bytes;
+		released.notify_all();
+	}
+
+private:
+	std::size_t const total;
+	std::size_t used;
+	std::mutex mutex;
+	std::condition_variable released;
+};
+
+/**
+\brief Runs work in count child processes (fork) and waits for all of them.
+\details Each child calls work with its number (0 to count - 1) and exits afterwards without returning,
+	so it neither runs destructors of the parent's objects nor flushes the parent's buffered output.
+	An exception in a child is printed to standard error and makes the child fail.
+	Call this only when no other threads are running.
+\param describe returns description of work of a child (like "buckets 1, 5, ...") for error messages
+\throws std::runtime_error if a child cannot be started or fails (or processes are not supported on this platform)
+*/
+void run_in_processes(unsigned count, std::function<std::string(unsigned)> const& describe, std::function<void(unsigned)> const& work);
+
+#endif // SETOP_PIPELINE_HPP
@@ -0,0 +1,955 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "regex_dfa.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+
+/** \brief maximal number of NFA instructions, larger patterns (e. g. with large counted repetitions) are left to Boost.Regex */
+#define DFA_MAX_INSTRUCTIONS 20000
+/** \brief maximal number of cached DFA states per direction, the cache is cleared when it is reached */
+#define DFA_MAX_STATES 2048
+/** \brief maximal number of strings searched by the LITERALS scanner, more are left to the automaton (working like Aho-Corasick then) */
+#define KERNEL_MAX_LITERALS 16
+/** \brief repetitions without upper bound in syntax {n,} */
+#define REPEAT_UNBOUNDED -1
+
+
+namespace
+{
+
+/** \brief thrown by PatternParser for unsupported features */
+struct Unsupported {};
+
+/** \brief node of syntax tree of pattern */
+struct Node
+{
+	enum Type { BYTES, CONCAT, ALTERNATIVE, REPEAT } type;
+	std::size_t byteset; ///< index of accepted bytes for BYTES
+	std::vector<Node> children; ///< for CONCAT and ALTERNATIVE all parts, for REPEAT the repeated one
+	int min, max; ///< number of repetitions for REPEAT, max may be REPEAT_UNBOUNDED
+	bool greedy; ///< REPEAT prefers more repetitions
+
+	explicit Node(Type type) : type(type), byteset(0), min(0), max(0), greedy(true) {}
+};
+
+/** \brief Returns lowest byte in set, -1 if empty. */
+int first_byte(std::bitset<256> const& bytes)
+{
+	for (int byte = 0; byte < 256; ++byte)
+		if (bytes.test(byte))
+			return byte;
+	return -1;
+}
+
+/** \brief Returns if node matches the empty string. */
+bool nullable(Node const& node)
+{
+	switch (node.type)
+	{
+	case Node::BYTES:
+		return false;
+	case Node::CONCAT:
+		return std::all_of(node.children.begin(), node.children.end(), nullable);
+	case Node::ALTERNATIVE:
+		return std::any_of(node.children.begin(), node.children.end(), nullable);
+	case Node::REPEAT:
+		return node.min == 0 || nullable(node.children.front());
+	}
+	return false;
+}
+
+/**
+\brief Collects strings if node is a string or an alternative of strings (like \\r\\n|;|,).
+\return false if node matches anything else
+*/
+bool literal_alternatives(Node const& node, std::vector<std::bitset<256>> const& byte_sets, std::vector<std::string>& literals)
+{
+	auto const single_byte = [&byte_sets](Node const& part)
+	{
+		return part.type == Node::BYTES && byte_sets[part.byteset].count() == 1;
+	};
+
+	switch (node.type)
+	{
+	case Node::BYTES:
+		if (!single_byte(node))
+			return false;
+		literals.push_back(std::string(1, static_cast<char>(first_byte(byte_sets[node.byteset]))));
+		return true;
+	case Node::CONCAT:
+	{
+		std::string literal;
+		for (Node const& child : node.children)
+		{
+			if (!single_byte(child))
+				return false;
+			literal.push_back(static_cast<char>(first_byte(byte_sets[child.byteset])));
+		}
+		literals.push_back(literal);
+		return true;
+	}
+	case Node::ALTERNATIVE:
+		for (Node const& child : node.children)
+			if (!literal_alternatives(child, byte_sets, literals))
+				return false;
+		return true;
+	case Node::REPEAT:
+		return false;
+	}
+	return false;
+}
+
+/** \brief Returns all bytes a match of node can begin with. */
+std::bitset<256> leading_bytes(Node const& node, std::vector<std::bitset<256>> const& byte_sets)
+{
+	std::bitset<256> bytes;
+	switch (node.type)
+	{
+	case Node::BYTES:
+		bytes = byte_sets[node.byteset];
+		break;
+	case Node::CONCAT:
+		for (Node const& child : node.children)
+		{
+			bytes |= leading_bytes(child, byte_sets);
+			if (!nullable(child))
+				break;
+		}
+		break;
+	case Node::ALTERNATIVE:
+		for (Node const& child : node.children)
+			bytes |= leading_bytes(child, byte_sets);
+		break;
+	case Node::REPEAT:
+		bytes = leading_bytes(node.children.front(), byte_sets);
+		break;
+	}
+	return bytes;
+}
+
+/**
+\brief Appends string all matches of node begin with to prefix.
+\return true if node matches exactly this string, so that following nodes can extend the prefix
+*/
+bool literal_prefix(Node const& node, std::vector<std::bitset<256>> const& byte_sets, std::string& prefix)
+{
+	switch (node.type)
+	{
+	case Node::BYTES:
+		if (byte_sets[node.byteset].count() != 1)
+			return false;
+		prefix.push_back(static_cast<char>(first_byte(byte_sets[node.byteset])));
+		return true;
+	case Node::CONCAT:
+		for (Node const& child : node.children)
+			if (!literal_prefix(child, byte_sets, prefix))
+				return false;
+		return true;
+	case Node::ALTERNATIVE:
+	{
+		// common beginning of all alternatives
+		std::vector<std::string> prefixes(node.children.size());
+		bool complete = true;
+		for (std::size_t i = 0; i < node.children.size(); ++i)
+			complete = literal_prefix(node.children[i], byte_sets, prefixes[i]) && complete;
+		std::size_t common = prefixes.front().size();
+		for (std::string const& other : prefixes)
+		{
+			common = std::min(common, other.size());
+			common = std::mismatch(prefixes.front().begin(), prefixes.front().begin() + common, other.begin()).first - prefixes.front().begin();
+		}
+		prefix.append(prefixes.front(), 0, common);
+		return complete && std::all_of(prefixes.begin(), prefixes.end(),
+			[&prefixes](std::string const& other) { return other == prefixes.front(); });
+	}
+	case Node::REPEAT:
+	{
+		if (node.min == 0)
+			return false;
+		std::string repeated;
+		bool const complete = literal_prefix(node.children.front(), byte_sets, repeated);
+		if (!complete || node.min != node.max)
+		{
+			prefix += repeated;
+			return false;
+		}
+		for (int i = 0; i < node.min; ++i)
+			prefix += repeated;
+		return true;
+	}
+	}
+	return false;
+}
+
+/**
+\brief Returns if a match of node can begin with a lazy repetition with upper bound (like a{0,2}?).
+\details Boost.Regex skips start positions covered by such a leading repetition after a failed attempt,
+	which a DFA cannot reproduce; so patterns like these are left to Boost.Regex.
+*/
+bool lazy_bounded_start(Node const& node)
+{
+	switch (node.type)
+	{
+	case Node::BYTES:
+		return false;
+	case Node::CONCAT:
+		for (Node const& child : node.children)
+		{
+			if (lazy_bounded_start(child))
+				return true;
+			if (!nullable(child))
+				break;
+		}
+		return false;
+	case Node::ALTERNATIVE:
+		return std::any_of(node.children.begin(), node.children.end(), lazy_bounded_start);
+	case Node::REPEAT:
+		return (!node.greedy && node.max != REPEAT_UNBOUNDED) || lazy_bounded_start(node.children.front());
+	}
+	return false;
+}
+
+/**
+\brief Parses the regular subset of ECMAScript syntax (as used by Boost.Regex) into a syntax tree
+\details Throws Unsupported for everything else; syntax errors need not be handled because Boost.Regex has checked the pattern before.
+*/
+class PatternParser
+{
+public:
+	PatternParser(std::string const& pattern, std::vector<std::bitset<256>>& byte_sets) : pattern(pattern), pos(0), byte_sets(byte_sets) {}
+
+	Node parse()
+	{
+		Node root = parse_alternative();
+		if (pos != pattern.size())
+			throw Unsupported();
+		return root;
+	}
+
+private:
+	bool at_end() const { return pos == pattern.size(); }
+	char peek() const { return pattern[pos]; }
+
+	std::size_t add_byteset(std::bitset<256> const& bytes)
+	{
+		byte_sets.push_back(bytes);
+		return byte_sets.size() - 1;
+	}
+
+	Node bytes_node(std::bitset<256> const& bytes)
+	{
+		Node node(Node::BYTES);
+		node.byteset = add_byteset(bytes);
+		return node;
+	}
+
+	static std::bitset<256> classified(int (*is_class)(int))
+	{
+		std::bitset<256> bytes;
+		for (int c = 0; c < 256; ++c)
+			if (is_class(c))
+				bytes.set(c);
+		return bytes;
+	}
+
+	static int is_word(int c)
+	{
+		return std::isalnum(c) || c == '_';
+	}
+
+	static int is_blank(int c)
+	{
+		// Boost.Regex counts vertical tab as blank, too
+		return std::isblank(c) || c == '\v';
+	}
+
+	Node parse_alternative()
+	{
+		Node alternative(Node::ALTERNATIVE);
+		alternative.children.push_back(parse_concat());
+		while (!at_end() && peek() == '|')
+		{
+			++pos;
+			alternative.children.push_back(parse_concat());
+		}
+		return alternative.children.size() == 1 ? std::move(alternative.children.front()) : std::move(alternative);
+	}
+
+	Node parse_concat()
+	{
+		Node concat(Node::CONCAT);
+		while (!at_end() && peek() != '|' && peek() != ')')
+			concat.children.push_back(parse_repeat());
+		return concat.children.size() == 1 ? std::move(concat.children.front()) : std::move(concat);
+	}
+
+	Node parse_repeat()
+	{
+		Node atom = parse_atom();
+		if (at_end())
+			return atom;
+
+		int min, max;
+		switch (peek())
+		{
+		case '*': min = 0; max = REPEAT_UNBOUNDED; ++pos; break;
+		case '+': min = 1; max = REPEAT_UNBOUNDED; ++pos; break;
+		case '?': min = 0; max = 1; ++pos; break;
+		case '{':
+			++pos;
+			min = parse_number();
+			max = min;
+			if (!at_end() && peek() == ',')
+			{
+				++pos;
+				max = (!at_end() && peek() == '}' ? REPEAT_UNBOUNDED : parse_number());
+			}
+			if (at_end() || peek() != '}' || (max != REPEAT_UNBOUNDED && max < min))
+				throw Unsupported();
+			++pos;
+			break;
+		default:
+			return atom;
+		}
+
+		Node repeat(Node::REPEAT);
+		repeat.min = min;
+		repeat.max = max;
+		if (!at_end() && peek() == '?')
+		{
+			repeat.greedy = false;
+			++pos;
+		}
+		// possessive quantifiers and repeated quantifiers are left to Boost.Regex
+		if (!at_end() && (peek() == '+' || peek() == '*' || peek() == '?' || peek() == '{'))
+			throw Unsupported();
+		// backtracking engines treat empty iterations specially, so keep it simple
+		if (max != 1 && nullable(atom))
+			throw Unsupported();
+		repeat.children.push_back(std::move(atom));
+		return repeat;
+	}
+
+	int parse_number()
+	{
+		if (at_end() || !std::isdigit(static_cast<unsigned char>(peek())))
+			throw Unsupported();
+		int number = 0;
+		while (!at_end() && std::isdigit(static_cast<unsigned char>(peek())))
+		{
+			number = number * 10 + (peek() - '0');
+			if (number > DFA_MAX_INSTRUCTIONS)
+				throw Unsupported();
+			++pos;
+		}
+		return number;
+	}
+
+	Node parse_atom()
+	{
+		char const c = pattern[pos++];
+		switch (c)
+		{
+		case '(':
+		{
+			if (!at_end() && peek() == '?')
+			{
+				// only non-capturing groups, no lookarounds or modifiers
+				if (pos + 1 >= pattern.size() || pattern[pos + 1] != ':')
+					throw Unsupported();
+				pos += 2;
+			}
+			Node group = parse_alternative();
+			if (at_end() || peek() != ')')
+				throw Unsupported();
+			++pos;
+			return group;
+		}
+		case '[':
+			return bytes_node(parse_class());
+		case '.':
+			return bytes_node(std::bitset<256>().set());
+		case '\\':
+			return bytes_node(parse_escape(false));
+		case '^': case '$': case ')': case '*': case '+': case '?': case '{': case '}': case '|':
+			throw Unsupported();
+		default:
+			return bytes_node(std::bitset<256>().set(static_cast<unsigned char>(c)));
+		}
+	}
+
+	/** \brief Parses escape sequence behind backslash to set of bytes. */
+	std::bitset<256> parse_escape(bool in_class)
+	{
+		if (at_end())
+			throw Unsupported();
+		char const c = pattern[pos++];
+		switch (c)
+		{
+		case 'd': return classified(std::isdigit);
+		case 'D': return ~classified(std::isdigit);
+		case 'w': return classified(is_word);
+		case 'W': return ~classified(is_word);
+		case 's': return classified(std::isspace);
+		case 'S': return ~classified(std::isspace);
+		case 'n': return std::bitset<256>().set('\n');
+		case 't': return std::bitset<256>().set('\t');
+		case 'r': return std::bitset<256>().set('\r');
+		case 'f': return std::bitset<256>().set('\f');
+		case 'v': return std::bitset<256>().set('\v');
+		case 'x':
+		{
+			if (pos + 2 > pattern.size() || !std::isxdigit(static_cast<unsigned char>(pattern[pos])) ||
+				!std::isxdigit(static_cast<unsigned char>(pattern[pos + 1])))
+				throw Unsupported();
+			int const byte = std::stoi(pattern.substr(pos, 2), nullptr, 16);
+			pos += 2;
+			return std::bitset<256>().set(byte);
+		}
+		default:
+			// escaped punctuation stands for itself; letters and digits have special meanings (like back references)
+			(void)in_class;
+			if (std::isalnum(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80)
+				throw Unsupported();
+			return std::bitset<256>().set(static_cast<unsigned char>(c));
+		}
+	}
+
+	/** \brief Parses character class behind [ up to and including ]. */
+	std::bitset<256> parse_class()
+	{
+		bool const negated = (!at_end() && peek() == '^');
+		if (negated)
+			++pos;
+
+		std::bitset<256> bytes;
+		bool first = true;
+		while (true)
+		{
+			if (at_end())
+				throw Unsupported();
+			if (peek() == ']' && !first)
+			{
+				++pos;
+				break;
+			}
+			first = false;
+
+			int low = -1; // single byte of item, -1 if item is a set
+			if (peek() == '[' && pos + 1 < pattern.size() && pattern[pos + 1] == ':')
+			{
+				bytes |= parse_posix_class();
+			}
+			else if (peek() == '[' && pos + 1 < pattern.size() && (pattern[pos + 1] == '=' || pattern[pos + 1] == '.'))
+			{
+				throw Unsupported();
+			}
+			else if (peek() == '\\')
+			{
+				++pos;
+				std::bitset<256> const escaped = parse_escape(true);
+				if (escaped.count() == 1)
+					low = first_byte(escaped);
+				else
+					bytes |= escaped;
+			}
+			else
+			{
+				low = static_cast<unsigned char>(pattern[pos++]);
+			}
+
+			if (low < 0)
+				continue;
+			// range like a-z, but - before ] is a literal
+			if (pos + 1 < pattern.size() && peek() == '-' && pattern[pos + 1] != ']')
+			{
+				++pos;
+				int high;
+				if (peek() == '\\')
+				{
+					++pos;
+					std::bitset<256> const escaped = parse_escape(true);
+					if (escaped.count() != 1)
+						throw Unsupported();
+					high = first_byte(escaped);
+				}
+				else if (peek() == '[')
+				{
+					throw Unsupported();
+				}
+				else
+				{
+					high = static_cast<unsigned char>(pattern[pos++]);
+				}
+				if (high < low)
+					throw Unsupported();
+				for (int byte = low; byte <= high; ++byte)
+					bytes.set(byte);
+			}
+			else
+			{
+				bytes.set(low);
+			}
+		}
+		return negated ? ~bytes : bytes;
+	}
+
+	/** \brief Parses class like [:space:] inside of brackets. */
+	std::bitset<256> parse_posix_class()
+	{
+		std::size_t const name_end = pattern.find(":]", pos + 2);
+		if (name_end == std::string::npos)
+			throw Unsupported();
+		std::string const name = pattern.substr(pos + 2, name_end - pos - 2);
+		pos = name_end + 2;
+
+		static struct { char const* name; int (*is_class)(int); } const classes[] =
+		{
+			{ "alnum", std::isalnum }, { "alpha", std::isalpha }, { "blank", is_blank }, { "cntrl", std::iscntrl },
+			{ "digit", std::isdigit }, { "graph", std::isgraph }, { "lower", std::islower }, { "print", std::isprint },
+			{ "punct", std::ispunct }, { "space", std::isspace }, { "upper", std::isupper }, { "xdigit", std::isxdigit }
+		};
+		for (auto const& posix_class : classes)
+			if (name == posix_class.name)
+				return classified(posix_class.is_class);
+		throw Unsupported();
+	}
+
+	std::string const& pattern;
+	std::size_t pos;
+	std::vector<std::bitset<256>>& byte_sets;
+};
+
+/** \brief Translates syntax tree into NFA instructions (Thompson construction with ordered alternatives). */
+template <typename Instruction>
+class ProgramCompiler
+{
+public:
+	ProgramCompiler(std::vector<Instruction>& program, bool backward) : program(program), backward(backward) {}
+
+	/** \brief Appends instructions matching node and continuing with next, returns first of them. */
+	int compile(Node const& node, int next)
+	{
+		if (program.size() > DFA_MAX_INSTRUCTIONS)
+			throw Unsupported();
+		switch (node.type)
+		{
+		case Node::BYTES:
+			return add(Instruction{ Instruction::BYTES, next, -1, node.byteset });
+		case Node::CONCAT:
+			if (backward)
+				for (auto child = node.children.begin(); child != node.children.end(); ++child)
+					next = compile(*child, next);
+			else
+				for (auto child = node.children.rbegin(); child != node.children.rend(); ++child)
+					next = compile(*child, next);
+			return next;
+		case Node::ALTERNATIVE:
+		{
+			int first = compile(node.children.back(), next);
+			for (auto child = node.children.rbegin() + 1; child != node.children.rend(); ++child)
+				first = add(Instruction{ Instruction::SPLIT, compile(*child, next), first, 0 });
+			return first;
+		}
+		case Node::REPEAT:
+		{
+			Node const& child = node.children.front();
+			int first = next;
+			if (node.max == REPEAT_UNBOUNDED)
+			{
+				int const loop = add(Instruction{ Instruction::SPLIT, -1, -1, 0 });
+				int const body = compile(child, loop);
+				program[loop].next = node.greedy ? body : next;
+				program[loop].alternative = node.greedy ? next : body;
+				first = loop;
+			}
+			else
+			{
+				// optional repetitions nested like (x(x)?)?, each one can skip all following ones
+				for (int i = node.min; i < node.max; ++i)
+				{
+					int const body = compile(child, first);
+					first = add(node.greedy ? Instruction{ Instruction::SPLIT, body, next, 0 } : Instruction{ Instruction::SPLIT, next, body, 0 });
+				}
+			}
+			for (int i = 0; i < node.min; ++i)
+				first = compile(child, first);
+			return first;
+		}
+		}
+		return next;
+	}
+
+	int add(Instruction const& instruction)
+	{
+		program.push_back(instruction);
+		return static_cast<int>(program.size()) - 1;
+	}
+
+private:
+	std::vector<Instruction>& program;
+	bool const backward;
+};
+
+} // namespace
+
+
+std::unique_ptr<RegexDfa> RegexDfa::create(std::string const& pattern)
+{
+	std::unique_ptr<RegexDfa> dfa(new RegexDfa());
+	try
+	{
+		Node const root = PatternParser(pattern, dfa->byte_sets).parse();
+		if (nullable(root) || lazy_bounded_start(root))
+			return nullptr;
+
+		// specialized scanners for simple patterns
+		auto single_byte = [&dfa](Node const& node)
+		{
+			return node.type == Node::BYTES && dfa->byte_sets[node.byteset].count() == 1;
+		};
+		auto use_bytes = [&dfa](Node const& node)
+		{
+			for (int byte = 0; byte < 256; ++byte)
+				dfa->kernel_bytes[byte] = dfa->byte_sets[node.byteset].test(byte);
+		};
+
+		if (single_byte(root))
+		{
+			dfa->kernel = Kernel::BYTE;
+			dfa->kernel_byte = static_cast<unsigned char>(first_byte(dfa->byte_sets[root.byteset]));
+		}
+		else if (root.type == Node::BYTES ||
+			// lazy run matches one byte only
+			(root.type == Node::REPEAT && root.min == 1 && !root.greedy && root.children.front().type == Node::BYTES))
+		{
+			Node const& bytes = (root.type == Node::BYTES ? root : root.children.front());
+			dfa->kernel = Kernel::BYTE_SET;
+			use_bytes(bytes);
+		}
+		else if (root.type == Node::REPEAT && root.min == 1 && root.max == REPEAT_UNBOUNDED && root.greedy &&
+			root.children.front().type == Node::BYTES)
+		{
+			dfa->kernel = Kernel::BYTE_RUN;
+			use_bytes(root.children.front());
+		}
+		else if (root.type == Node::CONCAT && root.children.size() == 2 &&
+			root.children[0].type == Node::REPEAT && root.children[0].min == 0 && root.children[0].max == 1 &&
+			single_byte(root.children[0].children.front()) && single_byte(root.children[1]))
+		{
+			int const optional_byte = first_byte(dfa->byte_sets[root.children[0].children.front().byteset]);
+			int const byte = first_byte(dfa->byte_sets[root.children[1].byteset]);
+			// for a?a the leftmost match can be longer
+			if (optional_byte != byte)
+			{
+				dfa->kernel = Kernel::OPTIONAL_BYTE_PAIR;
+				dfa->kernel_optional_byte = static_cast<unsigned char>(optional_byte);
+				dfa->kernel_byte = static_cast<unsigned char>(byte);
+			}
+		}
+		else if (literal_alternatives(root, dfa->byte_sets, dfa->kernel_literals) && dfa->kernel_literals.size() <= KERNEL_MAX_LITERALS)
+		{
+			dfa->kernel = Kernel::LITERALS;
+			std::fill(std::begin(dfa->kernel_bytes), std::end(dfa->kernel_bytes), false);
+			for (std::string const& literal : dfa->kernel_literals)
+				dfa->kernel_bytes[static_cast<unsigned char>(literal.front())] = true;
+		}
+		if (dfa->kernel != Kernel::LITERALS)
+			dfa->kernel_literals.clear();
+		literal_prefix(root, dfa->byte_sets, dfa->required_prefix);
+		std::bitset<256> const first = leading_bytes(root, dfa->byte_sets);
+		for (int byte = 0; byte < 256; ++byte)
+			dfa->first_bytes[byte] = first.test(byte);
+
+		// forward: lowest priority loop over any byte in front of pattern searches for leftmost match
+		Automaton& forward = dfa->forward;
+		ProgramCompiler<Instruction> forward_compiler(forward.program, false);
+		int const forward_match = forward_compiler.add(Instruction{ Instruction::MATCH, -1, -1, 0 });
+		int const pattern_start = forward_compiler.compile(root, forward_match);
+		dfa->byte_sets.push_back(std::bitset<256>().set());
+		int const search_loop = forward_compiler.add(Instruction{ Instruction::BYTES, -1, -1, dfa->byte_sets.size() - 1 });
+		forward.start = forward_compiler.add(Instruction{ Instruction::SPLIT, pattern_start, search_loop, 0 });
+		forward.program[search_loop].next = forward.start;
+		forward.first_match = true;
+		forward.search_loop = search_loop;
+
+		// backward: reversed pattern, anchored at end of match, longest match gives leftmost begin
+		Automaton& backward = dfa->backward;
+		ProgramCompiler<Instruction> backward_compiler(backward.program, true);
+		int const backward_match = backward_compiler.add(Instruction{ Instruction::MATCH, -1, -1, 0 });
+		backward.start = backward_compiler.compile(root, backward_match);
+		backward.first_match = false;
+		backward.search_loop = -1;
+	}
+	catch (Unsupported const&)
+	{
+		return nullptr;
+	}
+
+	dfa->reset(dfa->forward);
+	dfa->reset(dfa->backward);
+	return dfa;
+}
+
+RegexDfa::Match RegexDfa::find_with_kernel(char const* begin, char const* end, bool at_end) const
+{
+	switch (kernel)
+	{
+	case Kernel::BYTE:
+	{
+		char const* const found = static_cast<char const*>(std::memchr(begin, kernel_byte, end - begin));
+		if (!found)
+			return Match{ Match::NONE, nullptr, end };
+		return Match{ Match::FOUND, found, found + 1 };
+	}
+	case Kernel::BYTE_SET:
+	case Kernel::BYTE_RUN:
+	{
+		char const* first = begin;
+		while (first != end && !kernel_bytes[static_cast<unsigned char>(*first)])
+			++first;
+		if (first == end)
+			return Match{ Match::NONE, nullptr, end };
+		char const* last = first + 1;
+		if (kernel == Kernel::BYTE_RUN)
+		{
+			while (last != end && kernel_bytes[static_cast<unsigned char>(*last)])
+				++last;
+			// run could go on behind end
+			if (last == end && !at_end)
+				return Match{ Match::MORE, nullptr, first };
+		}
+		return Match{ Match::FOUND, first, last };
+	}
+	case Kernel::OPTIONAL_BYTE_PAIR:
+	{
+		char const* const found = static_cast<char const*>(std::memchr(begin, kernel_byte, end - begin));
+		if (!found)
+		{
+			// optional byte at end could begin a match
+			if (!at_end && begin != end && static_cast<unsigned char>(end[-1]) == kernel_optional_byte)
+				return Match{ Match::MORE, nullptr, end - 1 };
+			return Match{ Match::NONE, nullptr, end };
+		}
+		bool const with_optional = (found != begin && static_cast<unsigned char>(found[-1]) == kernel_optional_byte);
+		return Match{ Match::FOUND, with_optional ? found - 1 : found, found + 1 };
+	}
+	case Kernel::LITERALS:
+	{
+		for (char const* curr = begin; curr != end; ++curr)
+		{
+			if (!kernel_bytes[static_cast<unsigned char>(*curr)])
+				continue;
+			// like a backtracking engine: first alternative matching at leftmost position
+			std::size_t const available = end - curr;
+			for (std::string const& literal : kernel_literals)
+			{
+				if (literal.size() <= available)
+				{
+					if (std::memcmp(curr, literal.data(), literal.size()) == 0)
+						return Match{ Match::FOUND, curr, curr + literal.size() };
+				}
+				else if (!at_end && std::memcmp(curr, literal.data(), available) == 0)
+				{
+					// preferred string could go on behind end
+					return Match{ Match::MORE, nullptr, curr };
+				}
+			}
+		}
+		return Match{ Match::NONE, nullptr, end };
+	}
+	case Kernel::NONE:
+		break;
+	}
+	return Match{ Match::NONE, nullptr, end };
+}
+
+char const* RegexDfa::find_prefix(char const* begin, char const* end) const
+{
+	// also returns an occurrence cut off by end, because it could go on behind end
+	for (char const* curr = begin; curr != end; ++curr)
+	{
+		curr = static_cast<char const*>(std::memchr(curr, required_prefix.front(), end - curr));
+		if (!curr)
+			return end;
+		std::size_t const available = std::min(required_prefix.size(), static_cast<std::size_t>(end - curr));
+		if (std::memcmp(curr, required_prefix.data(), available) == 0)
+			return curr;
+	}
+	return end;
+}
+
+void RegexDfa::reset(Automaton& automaton)
+{
+	automaton.states.clear();
+	automaton.accepting.clear();
+	automaton.transitions.clear();
+	automaton.fresh.clear();
+	automaton.state_ids.clear();
+
+	add_state(automaton, std::vector<int>(), false);
+	std::vector<int> start;
+	std::vector<bool> visited(automaton.program.size());
+	add_closure(automaton, automaton.start, start, visited);
+	add_state(automaton, start, true);
+}
+
+void RegexDfa::add_closure(Automaton const& automaton, int instruction, std::vector<int>& result, std::vector<bool>& visited)
+{
+	// depth-first in order of priority, with explicit stack because of long chains of optional repetitions
+	std::vector<int> pending(1, instruction);
+	while (!pending.empty())
+	{
+		int const curr = pending.back();
+		pending.pop_back();
+		if (visited[curr])
+			continue;
+		visited[curr] = true;
+		Instruction const& inst = automaton.program[curr];
+		if (inst.opcode == Instruction::SPLIT)
+		{
+			pending.push_back(inst.alternative);
+			pending.push_back(inst.next);
+		}
+		else
+		{
+			result.push_back(curr);
+		}
+	}
+}
+
+int RegexDfa::add_state(Automaton& automaton, std::vector<int> const& instructions, bool fresh)
+{
+	std::vector<int> key(instructions);
+	if (automaton.first_match)
+	{
+		// threads after a match have lower priority than it and can never win
+		for (auto it = key.begin(); it != key.end(); ++it)
+			if (automaton.program[*it].opcode == Instruction::MATCH)
+			{
+				key.erase(it + 1, key.end());
+				break;
+			}
+	}
+	else
+	{
+		// order does not matter for longest match
+		std::sort(key.begin(), key.end());
+	}
+
+	// same threads can have started at different positions (e. g. for ".*x"), so fresh is part of the identity
+	key.push_back(fresh ? 1 : 0);
+	auto const found = automaton.state_ids.find(key);
+	if (found != automaton.state_ids.end())
+		return found->second;
+
+	int const id = static_cast<int>(automaton.states.size());
+	automaton.state_ids.insert(std::make_pair(key, id));
+	key.pop_back();
+	automaton.accepting.push_back(std::any_of(key.begin(), key.end(),
+		[&automaton](int inst) { return automaton.program[inst].opcode == Instruction::MATCH; }));
+	automaton.fresh.push_back(fresh);
+	automaton.states.push_back(std::move(key));
+	automaton.transitions.resize(automaton.states.size() * 256, -1);
+	return id;
+}
+
+int RegexDfa::next_state(Automaton& automaton, int state, unsigned char byte)
+{
+	int const known = automaton.transitions[state * 256 + byte];
+	if (known >= 0)
+		return known;
+
+	if (automaton.states.size() >= DFA_MAX_STATES)
+	{
+		std::vector<int> const current = automaton.states[state];
+		bool const current_fresh = automaton.fresh[state];
+		reset(automaton);
+		state = add_state(automaton, current, current_fresh);
+	}
+
+	std::vector<int> next;
+	std::vector<bool> visited(automaton.program.size());
+	bool fresh = false;
+	for (int inst : automaton.states[state])
+	{
+		Instruction const& instruction = automaton.program[inst];
+		if (instruction.opcode == Instruction::BYTES && byte_sets[instruction.byteset].test(byte))
+		{
+			// threads before search loop (higher priority) started before
+			if (inst == automaton.search_loop)
+				fresh = next.empty();
+			add_closure(automaton, instruction.next, next, visited);
+		}
+	}
+	int const id = add_state(automaton, next, fresh);
+	automaton.transitions[state * 256 + byte] = id;
+	return id;
+}
+
+RegexDfa::Match RegexDfa::find(char const* begin, char const* end, bool at_end)
+{
+	if (kernel != Kernel::NONE)
+		return find_with_kernel(begin, end, at_end);
+
+	int state = START_STATE;
+	char const* quiet = begin; // no match can begin before
+	char const* match_end = nullptr;
+	char const* curr = begin;
+	for (; curr != end; ++curr)
+	{
+		if (forward.fresh[state] && !match_end)
+		{
+			// no thread alive, so the next match begins with the next occurrence of required prefix or of a first byte
+			if (!required_prefix.empty())
+				curr = find_prefix(curr, end);
+			else
+				while (curr != end && !first_bytes[static_cast<unsigned char>(*curr)])
+					++curr;
+			if (curr == end)
+				break;
+			quiet = curr;
+		}
+		state = step(forward, state, static_cast<unsigned char>(*curr));
+		if (state == DEAD_STATE)
+			break;
+		if (forward.accepting[state])
+			match_end = curr + 1;
+	}
+
+	if (curr == end && state != DEAD_STATE && !at_end)
+		return Match{ Match::MORE, nullptr, (forward.fresh[state] && !match_end) ? end : quiet };
+	if (!match_end)
+		return Match{ Match::NONE, nullptr, end };
+
+	// leftmost begin is the one of the longest match backwards from end (not before begin of search)
+	char const* match_begin = match_end;
+	state = START_STATE;
+	for (curr = match_end; curr != begin; )
+	{
+		--curr;
+		state = step(backward, state, static_cast<unsigned char>(*curr));
+		if (state == DEAD_STATE)
+			break;
+		if (backward.accepting[state])
+			match_begin = curr;
+	}
+	return Match{ Match::FOUND, match_begin, match_end };
+}
@@ -0,0 +1,133 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_REGEX_DFA_HPP
+#define SETOP_REGEX_DFA_HPP
+
+#include <cstddef>
+#include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "regex_engine.hpp"
+
+
+/**
+\file
+\brief Matching regular expressions in linear time with a lazily built DFA (no backtracking)
+*/
+
+
+/**
+\brief Finds matches of a regular expression with a deterministic automaton built on the fly
+\details Supports the regular subset of ECMAScript syntax as used by Boost.Regex: literals, escapes like \\n and \\x41,
+	character classes (also \\d, \\w, \\s, and [[:space:]] etc.), dot, groups, alternatives, and greedy or lazy quantifiers.
+	Matches are the same as those of a backtracking engine (leftmost, first alternative preferred): the end of a match
+	is found by a forward automaton whose states keep the threads of the NFA in order of priority, its begin by a
+	backward automaton. No input byte is looked at more than twice for finding a match, so there is no backtracking
+	on pathological patterns.
+	Anchors, word boundaries, back references, lookarounds, and patterns matching the empty string are not supported;
+	create returns null for them, so that Boost.Regex is used instead.
+	Frequent simple patterns (a single byte like \\n or a class, a run like \\d+ or [[:space:]]+, \\r?\\n, and
+	alternatives of a few strings like \\r\\n|;|,) are found by specialized scanners instead of the automaton.
+	If all matches begin with the same string (like user=\\w+), the automaton skips to its occurrences,
+	otherwise to the next byte a match can begin with.
+	States are cached (and the cache is cleared when it grows too large), so find is not thread-safe.
+*/
+class RegexDfa : public RegexEngine
+{
+public:
+	/**
+	\brief Compiles pattern if it is supported.
+	\param pattern regular expression in ECMAScript syntax, already checked to be valid by Boost.Regex
+	\return null if pattern uses unsupported features
+	*/
+	static std::unique_ptr<RegexDfa> create(std::string const& pattern);
+
+	Match find(char const* begin, char const* end, bool at_end) override;
+
+	std::unique_ptr<RegexEngine> clone() const override { return std::unique_ptr<RegexEngine>(new RegexDfa(*this)); }
+
+	/** \brief Returns if find runs the automaton, i. e. pattern is not handled by a much faster specialized scanner. */
+	bool parallelizable() const override { return kernel == Kernel::NONE; }
+
+private:
+	/** \brief instruction of NFA */
+	struct Instruction
+	{
+		enum Opcode { BYTES, SPLIT, MATCH } opcode;
+		int next; ///< following instruction; for SPLIT the preferred one
+		int alternative; ///< less preferred following instruction of SPLIT
+		std::size_t byteset; ///< index of accepted bytes for BYTES
+	};
+
+	/** \brief automaton for one direction, states are built when needed */
+	struct Automaton
+	{
+		std::vector<Instruction> program;
+		int start; ///< first instruction
+		bool first_match; ///< drop threads of lower priority than a match (forward), or keep all (backward, longest match)
+		int search_loop; ///< instruction starting new threads at each position (forward), or -1
+		std::vector<std::vector<int>> states; ///< instructions (BYTES, MATCH) of each state, in order of priority
+		std::vector<unsigned char> accepting; ///< state contains MATCH
+		std::vector<unsigned char> fresh; ///< all threads of state started at current position (none before), so a match cannot begin earlier
+		std::vector<int> transitions; ///< 256 per state, -1 if not computed yet
+		std::map<std::vector<int>, int> state_ids; ///< instructions and fresh flag (appended) to state
+	};
+
+	/** \brief specialized scanner for a simple pattern */
+	enum class Kernel
+	{
+		NONE, ///< use automaton
+		BYTE, ///< single byte like \\n or ,
+		BYTE_SET, ///< single byte of a class like [,;]
+		BYTE_RUN, ///< greedy run of bytes of a class like \\w+ or [[:space:]]+
+		OPTIONAL_BYTE_PAIR, ///< optional byte followed by another one like \\r?\\n
+		LITERALS ///< few alternative strings like \\r\\n|;|, (first one matching at a position wins)
+	};
+
+	Match find_with_kernel(char const* begin, char const* end, bool at_end) const;
+	char const* find_prefix(char const* begin, char const* end) const;
+
+	static int const DEAD_STATE = 0; ///< state without any threads, no match is possible anymore
+	static int const START_STATE = 1; ///< state before first byte
+
+	RegexDfa() = default;
+
+	/** \brief Returns state after byte, fast path for known transitions. */
+	int step(Automaton& automaton, int state, unsigned char byte)
+	{
+		int const known = automaton.transitions[state * 256 + byte];
+		return known >= 0 ? known : next_state(automaton, state, byte);
+	}
+	int next_state(Automaton& automaton, int state, unsigned char byte);
+	int add_state(Automaton& automaton, std::vector<int> const& instructions, bool fresh);
+	static void add_closure(Automaton const& automaton, int instruction, std::vector<int>& result, std::vector<bool>& visited);
+	void reset(Automaton& automaton);
+
+	std::vector<std::bitset<256>> byte_sets;
+	Kernel kernel = Kernel::NONE;
+	bool kernel_bytes[256]; ///< bytes of class for BYTE_SET and BYTE_RUN, first bytes of strings for LITERALS
+	unsigned char kernel_byte; ///< byte for BYTE, last byte for OPTIONAL_BYTE_PAIR
+	unsigned char kernel_optional_byte; ///< first byte for OPTIONAL_BYTE_PAIR
+	std::vector<std::string> kernel_literals; ///< strings for LITERALS in order of alternatives
+	std::string required_prefix; ///< string all matches begin with, may be empty
+	bool first_bytes[256]; ///< bytes a match can begin with
+	Automaton forward; ///< finds end of leftmost match, searching for its begin (unanchored)
+	Automaton backward; ///< finds begin of match from its end, reading backwards
+};
+
+#endif // SETOP_REGEX_DFA_HPP
@@ -0,0 +1,233 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "regex_engine.hpp"
+#include "regex_dfa.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <stdexcept>
+
+#ifdef SETOP_WITH_PCRE2
+	#define PCRE2_CODE_UNIT_WIDTH 8
+	#include <pcre2.h>
+#endif
+
+
+RegexEngineType regex_engine_from_name(std::string const& name)
+{
+	static struct { char const* name; RegexEngineType type; } const engines[] =
+	{
+		{ "auto", RegexEngineType::AUTO }, { "boost", RegexEngineType::BOOST },
+		{ "dfa", RegexEngineType::DFA }, { "pcre2", RegexEngineType::PCRE2 }
+	};
+	for (auto const& engine : engines)
+		if (name == engine.name)
+			return engine.type;
+	throw std::invalid_argument("Regular expression engine \"" + name + "\" is unknown.");
+}
+
+
+#ifdef SETOP_WITH_PCRE2
+
+/**
+\brief Finds matches with PCRE2, compiled to machine code if its JIT compiler is available
+\details Like for Boost.Regex, dot matches new lines and ^ and $ match at line breaks, too. Anchors and lookbehinds only see
+	the searched range, e. g. ^ always matches at begin of a search. Partial matching (PCRE2_PARTIAL_HARD) tells
+	if a match could go on behind end of buffer.
+*/
+class Pcre2Engine : public RegexEngine
+{
+public:
+	/** \throws std::runtime_error if pattern is invalid for PCRE2 or can match the empty string */
+	explicit Pcre2Engine(std::string const& pattern) : match_data(nullptr, pcre2_match_data_free)
+	{
+		int error;
+		PCRE2_SIZE error_offset;
+		pcre2_code* const compiled = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.data()), pattern.size(),
+			PCRE2_DOTALL | PCRE2_MULTILINE, &error, &error_offset, nullptr);
+		if (!compiled)
+		{
+			PCRE2_UCHAR message[256];
+			pcre2_get_error_message(error, message, sizeof(message));
+			throw std::runtime_error("\"" + pattern + "\" is not supported by engine pcre2: " + reinterpret_cast<char const*>(message) + ".");
+		}
+		// compiled code is only read while matching, so it is shared by all clones
+		code.reset(compiled, pcre2_code_free);
+
+		std::uint32_t min_length;
+		pcre2_pattern_info(compiled, PCRE2_INFO_MINLENGTH, &min_length);
+		if (min_length == 0)
+			throw std::runtime_error("\"" + pattern + "\" can match the empty string, which is not supported by engine pcre2.");
+		// without JIT compiler (e. g. on unsupported platforms) the interpreter is used
+		pcre2_jit_compile(compiled, PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD);
+		create_match_data();
+	}
+
+	Pcre2Engine(Pcre2Engine const& other) : RegexEngine(other), code(other.code), match_data(nullptr, pcre2_match_data_free)
+	{
+		create_match_data();
+	}
+
+	Match find(char const* begin, char const* end, bool at_end) override
+	{
+		PCRE2_SIZE start = 0;
+		while (true)
+		{
+			int const result = pcre2_match(code.get(), reinterpret_cast<PCRE2_SPTR>(begin), end - begin, start,
+				at_end ? 0 : PCRE2_PARTIAL_HARD, match_data.get(), nullptr);
+			PCRE2_SIZE const* const ovector = pcre2_get_ovector_pointer(match_data.get());
+			if (result == PCRE2_ERROR_NOMATCH)
+				return Match{ Match::NONE, nullptr, end };
+			if (result == PCRE2_ERROR_PARTIAL)
+				return Match{ Match::MORE, nullptr, begin + ovector[0] };
+			if (result < 0)
+			{
+				PCRE2_UCHAR message[256];
+				pcre2_get_error_message(result, message, sizeof(message));
+				throw std::runtime_error(std::string("Matching regular expression failed: ") + reinterpret_cast<char const*>(message) + ".");
+			}
+			if (ovector[0] < ovector[1])
+				return Match{ Match::FOUND, begin + ovector[0], begin + ovector[1] };
+
+			// empty match is still possible with \K or lookarounds, skip it
+			start = ovector[1] + 1;
+			if (start > static_cast<PCRE2_SIZE>(end - begin))
+				return Match{ at_end ? Match::NONE : Match::MORE, nullptr, end };
+		}
+	}
+
+	std::unique_ptr<RegexEngine> clone() const override
+	{
+		return std::unique_ptr<RegexEngine>(new Pcre2Engine(*this));
+	}
+
+	bool parallelizable() const override
+	{
+		return true;
+	}
+
+private:
+	void create_match_data()
+	{
+		match_data.reset(pcre2_match_data_create_from_pattern(code.get(), nullptr));
+		if (!match_data)
+			throw std::bad_alloc();
+	}
+
+	std::shared_ptr<pcre2_code> code;
+	std::unique_ptr<pcre2_match_data, void (*)(pcre2_match_data*)> match_data; ///< positions of last match, one for each thread
+};
+
+#endif // SETOP_WITH_PCRE2
+
+
+std::unique_ptr<RegexEngine> create_regex_engine(std::string const& pattern, RegexEngineType type)
+{
+	switch (type)
+	{
+	case RegexEngineType::AUTO:
+		return RegexDfa::create(pattern);
+	case RegexEngineType::BOOST:
+		return nullptr;
+	case RegexEngineType::DFA:
+	{
+		std::unique_ptr<RegexEngine> dfa = RegexDfa::create(pattern);
+		if (!dfa)
+			throw std::runtime_error("\"" + pattern + "\" is not supported by engine dfa "
+				"(because of anchors, word boundaries, back references, lookarounds, or matching the empty string).");
+		return dfa;
+	}
+	case RegexEngineType::PCRE2:
+#ifdef SETOP_WITH_PCRE2
+		return std::unique_ptr<RegexEngine>(new Pcre2Engine(pattern));
+#else
+		throw std::runtime_error("Engine pcre2 is not supported by this build of setop.");
+#endif
+	}
+	return nullptr;
+}
+
+
+MatchScan scan_matches(RegexEngine& engine, char const* from, char const* until, char const* end, bool at_end)
+{
+	MatchScan scan;
+	char const* pos = from;
+	while (pos < until || until == end)
+	{
+		scan.starts.push_back(pos);
+		RegexEngine::Match const match = engine.find(pos, end, at_end);
+		if (match.status != RegexEngine::Match::FOUND)
+		{
+			scan.tail = match;
+			return scan;
+		}
+		scan.matches.push_back(match);
+		pos = match.last;
+	}
+	scan.tail = RegexEngine::Match{ RegexEngine::Match::FOUND, nullptr, pos };
+	return scan;
+}
+
+MatchScan find_matches(std::vector<std::unique_ptr<RegexEngine>>& engines, char const* begin, char const* end, bool at_end,
+	std::size_t chunksize)
+{
+	std::size_t const chunks = std::max<std::size_t>(1, std::min<std::size_t>(engines.size(), (end - begin) / chunksize));
+	std::vector<char const*> bounds;
+	for (std::size_t chunk = 0; chunk <= chunks; ++chunk)
+		bounds.push_back(begin + (end - begin) * chunk / chunks);
+
+	std::vector<std::future<MatchScan>> speculative_scans;
+	for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+		speculative_scans.push_back(std::async(std::launch::async, scan_matches, std::ref(*engines[chunk]),
+			bounds[chunk], bounds[chunk + 1], end, at_end));
+	MatchScan result = scan_matches(*engines.front(), begin, bounds[1], end, at_end);
+
+	for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+	{
+		MatchScan const speculative = speculative_scans[chunk - 1].get();
+		// nothing to do when search of previous chunks has already reached end of buffer
+		if (result.tail.status != RegexEngine::Match::FOUND)
+			continue;
+
+		char const* pos = result.tail.last;
+		while (true)
+		{
+			auto const common = std::lower_bound(speculative.starts.begin(), speculative.starts.end(), pos);
+			if (common != speculative.starts.end() && *common == pos)
+			{
+				result.matches.insert(result.matches.end(), speculative.matches.begin() + (common - speculative.starts.begin()),
+					speculative.matches.end());
+				result.tail = speculative.tail;
+				break;
+			}
+			if (pos >= bounds[chunk + 1] && chunk + 1 < chunks)
+			{
+				result.tail = RegexEngine::Match{ RegexEngine::Match::FOUND, nullptr, pos };
+				break;
+			}
+			RegexEngine::Match const match = engines.front()->find(pos, end, at_end);
+			if (match.status != RegexEngine::Match::FOUND)
+			{
+				result.tail = match;
+				break;
+			}
+			result.matches.push_back(match);
+			pos = match.last;
+		}
+	}
+	return result;
+}
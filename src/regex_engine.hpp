@@ -0,0 +1,112 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETOP_REGEX_ENGINE_HPP
+#define SETOP_REGEX_ENGINE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+\file
+\brief Common interface of engines for finding input elements or separators, selection of an engine, and searching with engines in parallel
+\details PCRE2 is only available when setop is built with it, see macro SETOP_WITH_PCRE2 (set by Makefile).
+	Boost.Regex is used by parse_input directly (with its match_partial and iterator), so it has no engine object.
+*/
+
+
+/** \brief Finds matches of a regular expression in a buffer that is filled piece by piece */
+class RegexEngine
+{
+public:
+	/** \brief result of find */
+	struct Match
+	{
+		enum Status { FOUND, NONE, MORE } status; ///< match found; no match at all; match could depend on more input
+		char const* first; ///< begin of match if FOUND
+		char const* last; ///< end of match if FOUND; if MORE, no match begins before this position (keep input from here)
+	};
+
+	virtual ~RegexEngine() {}
+
+	/**
+	\brief Finds first match in [begin, end), it is never empty.
+	\details Result only depends on the bytes from begin to end, so any range can be searched independently.
+	\param at_end if there is no more input behind end; otherwise a match touching end could be longer,
+		so that MORE is returned instead
+	*/
+	virtual Match find(char const* begin, char const* end, bool at_end) = 0;
+
+	/** \brief Returns independent copy, e. g. for another thread (find is not thread-safe). */
+	virtual std::unique_ptr<RegexEngine> clone() const = 0;
+
+	/** \brief Returns if finding is expensive enough for searching large buffers in parallel. */
+	virtual bool parallelizable() const = 0;
+};
+
+/** \brief all regular expression engines known to setop */
+enum class RegexEngineType : unsigned char { AUTO, BOOST, DFA, PCRE2 };
+
+/**
+\brief Recognizes engine by name like "dfa".
+\throws std::invalid_argument
+*/
+RegexEngineType regex_engine_from_name(std::string const& name);
+
+/**
+\brief Compiles pattern for given engine.
+\details AUTO chooses the DFA (see RegexDfa) if it supports the pattern, because its matches are the same as those of Boost.Regex
+	(checked by 'make test'). Only at end of input the DFA finds more: parse_input stops using Boost.Regex at the first match
+	that could go on behind the end, although a complete match may start behind its begin.
+	Otherwise Boost.Regex is used: PCRE2 is faster for the remaining patterns (back references, lookarounds, anchors),
+	but its Perl semantics differ in corner cases, so it is only used on request.
+\param pattern regular expression in ECMAScript syntax, already checked to be valid by Boost.Regex
+\param type engine to use
+\return null if Boost.Regex shall be used
+\throws std::runtime_error if engine does not support pattern, or is not supported by this build
+*/
+std::unique_ptr<RegexEngine> create_regex_engine(std::string const& pattern, RegexEngineType type);
+
+
+/** \brief matches found in (a part of) a buffer, see scan_matches */
+struct MatchScan
+{
+	std::vector<RegexEngine::Match> matches; ///< found matches in order
+	std::vector<char const*> starts; ///< search position leading to each match, and to tail if it is no match
+	RegexEngine::Match tail; ///< NONE or MORE if search reached end of buffer, otherwise FOUND with last as next search position
+};
+
+/**
+\brief Finds consecutive matches as long as search position is before until (or up to end of buffer if until is end).
+\details Each search begins where the last match ends, as parse_input does.
+*/
+MatchScan scan_matches(RegexEngine& engine, char const* from, char const* until, char const* end, bool at_end);
+
+/**
+\brief Finds all matches in buffer like scan_matches, but speculatively in parallel.
+\details The buffer is cut into chunks, one for each engine. All chunks except the first one are searched by separate threads
+	from their beginning on, although the serial search would continue at the end of the last match in front of it
+	(which can also lie within a match of the speculative search). As matches only depend on the search position,
+	both searches agree from their first common search position on. So only the part of a chunk before that position
+	is searched again while stitching chunks together, usually not more than one match.
+\param engines one for each thread (they are not thread-safe)
+\param chunksize minimal number of bytes of each chunk, fewer chunks than engines are used for small buffers
+*/
+MatchScan find_matches(std::vector<std::unique_ptr<RegexEngine>>& engines, char const* begin, char const* end, bool at_end,
+	std::size_t chunksize);
+
+#endif // SETOP_REGEX_ENGINE_HPP
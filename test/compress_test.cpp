@@ -0,0 +1,202 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "../src/compress.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#ifdef SETOP_WITH_ZSTD
+	#include <zstd.h>
+#endif
+
+
+/**
+\file
+\brief Test of decompressing zstd inputs with several threads, run by 'make test' (only with WITH_ZSTD=1)
+\details Decompressed data must equal the original data, and a large single frame must not be held in memory as a whole.
+*/
+
+
+#ifdef SETOP_WITH_ZSTD
+
+/** \brief decompressed size of the large single frames */
+#define LARGE_FRAME_SIZE (256 << 20)
+/** \brief maximal growth of peak memory usage while decompressing a large frame */
+#define MAX_MEMORY_GROWTH (64 << 20)
+/** \brief number of threads decompressing */
+#define THREADS 4
+
+/** \brief Returns byte at position of test data, lines of text repeating after some KB, so that data compress well. */
+static char test_byte(std::size_t position)
+{
+	static std::string const block = []
+	{
+		std::string lines;
+		for (unsigned i = 0; i < 1000; ++i)
+			lines += "element " + std::to_string(i) + "\n";
+		return lines;
+	}();
+	return block[position % block.size()];
+}
+
+/**
+\brief Compresses test data from position first to last as one frame.
+\param pledge write decompressed size into frame header (like zstd does for files, but not for pipes)
+*/
+static std::string compress_frame(std::size_t first, std::size_t last, bool pledge)
+{
+	std::unique_ptr<ZSTD_CCtx, std::size_t(*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+	if (pledge)
+		ZSTD_CCtx_setPledgedSrcSize(context.get(), last - first);
+	std::string result;
+	std::vector<char> input(1 << 20), output(ZSTD_CStreamOutSize());
+	std::size_t remaining;
+	do
+	{
+		std::size_t const size = std::min(input.size(), last - first);
+		for (std::size_t i = 0; i < size; ++i)
+			input[i] = test_byte(first + i);
+		first += size;
+		ZSTD_inBuffer in = { input.data(), size, 0 };
+		ZSTD_EndDirective const mode = (first == last ? ZSTD_e_end : ZSTD_e_continue);
+		do
+		{
+			ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+			remaining = ZSTD_compressStream2(context.get(), &out, &in, mode);
+			if (ZSTD_isError(remaining))
+				throw std::runtime_error(ZSTD_getErrorName(remaining));
+			result.append(output.data(), out.pos);
+		} while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+	} while (first < last);
+	return result;
+}
+
+/** \brief Input from memory */
+class StringSource : public InputSource
+{
+public:
+	explicit StringSource(std::string const& data) : data(data), position(0) {}
+
+	std::size_t read(char* dest, std::size_t size) override
+	{
+		std::size_t const n = std::min(size, data.size() - position);
+		std::memcpy(dest, data.data() + position, n);
+		position += n;
+		return n;
+	}
+
+private:
+	std::string const& data;
+	std::size_t position;
+};
+
+static long peak_memory_kb()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/**
+\brief Decompresses data with several threads and compares it with test data.
+\param size expected decompressed size
+\param max_growth maximal growth of peak memory usage, 0 for no limit
+\return if test passed
+*/
+static bool test_decompression(char const* description, std::string const& compressed, std::size_t size, std::size_t max_growth)
+{
+	long const memory_before = peak_memory_kb();
+	std::unique_ptr<InputSource> source(new StringSource(compressed));
+	bool decompressing;
+	source = open_decompressed(std::move(source), "test", THREADS, decompressing);
+
+	std::vector<char> buffer(64 << 10);
+	std::size_t position = 0;
+	bool correct = decompressing;
+	try
+	{
+		std::size_t read;
+		do
+		{
+			read = source->read(buffer.data(), buffer.size());
+			for (std::size_t i = 0; i < read && correct; ++i)
+				correct = (buffer[i] == test_byte(position + i));
+			position += read;
+		} while (read == buffer.size() && correct);
+	}
+	catch (std::runtime_error const& e)
+	{
+		std::cout << description << ": " << e.what() << std::endl;
+		return false;
+	}
+	source.reset();
+	std::size_t const growth = static_cast<std::size_t>(peak_memory_kb() - memory_before) << 10;
+
+	bool const passed = correct && position == size && (max_growth == 0 || growth <= max_growth);
+	std::cout << description << ": " << (passed ? "passed" : "FAILED") << " (" << position << " of " << size << " bytes" <<
+		(correct ? "" : ", wrong data") << ", peak memory grew by " << (growth >> 20) << " MB)" << std::endl;
+	return passed;
+}
+
+int main()
+{
+	unsigned failures = 0;
+
+	// large frames from zstd (with and without decompressed size in header) must be streamed
+	if (!test_decompression("large single frame", compress_frame(0, LARGE_FRAME_SIZE, true), LARGE_FRAME_SIZE, MAX_MEMORY_GROWTH))
+		++failures;
+	if (!test_decompression("large frame of unknown size", compress_frame(0, LARGE_FRAME_SIZE, false), LARGE_FRAME_SIZE, MAX_MEMORY_GROWTH))
+		++failures;
+
+	// many small frames (like written by pzstd or setop) are decompressed in parallel, a large one in between is streamed
+	std::string frames;
+	std::size_t size = 0;
+	for (unsigned i = 0; i < 40; ++i, size += 1000003)
+		frames += compress_frame(size, size + 1000003, true);
+	if (!test_decompression("small frames", frames, size, 0))
+		++failures;
+	frames += compress_frame(size, size + (32 << 20), true);
+	size += (32 << 20);
+	frames += compress_frame(size, size + 12345, true);
+	size += 12345;
+	if (!test_decompression("small frames with large one", frames, size, 0))
+		++failures;
+
+	// truncated input must be reported
+	std::string truncated = compress_frame(0, 1000, true) + compress_frame(1000, 100000, true);
+	truncated.resize(truncated.size() - 5);
+	if (test_decompression("truncated frame (error expected)", truncated, 100000, 0))
+		++failures;
+
+	std::cout << failures << " tests failed." << std::endl;
+	return (failures == 0 ? 0 : 1);
+}
+
+#else
+
+int main()
+{
+	std::cout << "Test of zstd decompression skipped, this build does not support zstd." << std::endl;
+	return 0;
+}
+
+#endif // SETOP_WITH_ZSTD
@@ -0,0 +1,123 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "../src/regex_engine.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+\file
+\brief Test of speculative parallel search (find_matches) against serial search (scan_matches), run by 'make test'
+\details Chunks are made tiny, so that many matches cross chunk boundaries. Some patterns let the speculative search
+	of a chunk begin out of step with the serial one (e. g. inside a quoted string), so that it is only stitched
+	after searching again, or never catches up within its chunk.
+*/
+
+
+/** \brief number of random inputs per pattern */
+#define RANDOM_INPUTS 40
+/** \brief maximal length of random inputs */
+#define RANDOM_INPUT_LENGTH 3000
+/** \brief number of reported mismatches, the test goes on silently afterwards */
+#define REPORTED_FAILURES 20
+
+static std::mt19937 random_generator(20151120);
+
+static std::size_t random_below(std::size_t limit)
+{
+	return random_generator() % limit;
+}
+
+/** \brief Returns random input of given characters, sometimes with long runs of one character. */
+static std::string random_input(std::string const& characters)
+{
+	std::string input;
+	std::size_t const length = random_below(RANDOM_INPUT_LENGTH + 1);
+	while (input.size() < length)
+		input.append(random_below(10) == 0 ? 1 + random_below(200) : 1, characters[random_below(characters.size())]);
+	return input;
+}
+
+/** \brief Returns if both scans found the same matches and end the same way. */
+static bool same_scan(MatchScan const& expected, MatchScan const& scan)
+{
+	if (expected.matches.size() != scan.matches.size() || expected.tail.status != scan.tail.status)
+		return false;
+	for (std::size_t i = 0; i < expected.matches.size(); ++i)
+		if (expected.matches[i].first != scan.matches[i].first || expected.matches[i].last != scan.matches[i].last)
+			return false;
+	return expected.tail.status != RegexEngine::Match::MORE || expected.tail.last == scan.tail.last;
+}
+
+int main()
+{
+	// pattern and characters of its inputs
+	static struct { char const* pattern; char const* characters; } const cases[] =
+	{
+		{ "\\n", "ab\n" }, // specialized scanner
+		{ "[^,\\n]+", "ab,\n" },
+		{ "\\w+", "ab .\n" },
+		{ "a[^b]*b", "abcc\n" }, // long matches across several chunks
+		{ "\\w+ \\w+", "ab  c" }, // pairs of words, speculative search may pair them the other way round
+		{ "\"[^\"]*\"", "\"\"ab ,\n" }, // quoted strings, speculative search may take text between them for quoted
+		{ "(?:ab)+|ba", "aab" },
+		{ "x{3}", "xxxy" },
+		{ "a+?b|c", "aabc" }
+	};
+	static std::size_t const chunksizes[] = { 1, 3, 16, 100 };
+	static std::size_t const thread_counts[] = { 2, 3, 5, 8 };
+
+	unsigned failures = 0;
+	unsigned long long scans = 0;
+	for (auto const& test : cases)
+	{
+		std::unique_ptr<RegexEngine> const engine = create_regex_engine(test.pattern, RegexEngineType::DFA);
+		std::vector<std::string> inputs = { "", std::string(1, test.characters[0]) };
+		for (std::size_t i = 0; i < RANDOM_INPUTS; ++i)
+			inputs.push_back(random_input(test.characters));
+
+		for (std::string const& input : inputs)
+			for (bool const at_end : { true, false })
+			{
+				char const* const begin = input.data();
+				char const* const end = begin + input.size();
+				MatchScan const expected = scan_matches(*engine, begin, end, end, at_end);
+				for (std::size_t const threads : thread_counts)
+				{
+					std::vector<std::unique_ptr<RegexEngine>> engines;
+					while (engines.size() < threads)
+						engines.push_back(engine->clone());
+					for (std::size_t const chunksize : chunksizes)
+					{
+						++scans;
+						if (same_scan(expected, find_matches(engines, begin, end, at_end, chunksize)))
+							continue;
+						if (++failures <= REPORTED_FAILURES)
+							std::cout << "Pattern /" << test.pattern << "/ on input of " << input.size() << " bytes" <<
+								(at_end ? "" : " (not at end)") << " with " << threads << " threads and chunks of at least " <<
+								chunksize << " bytes differs from serial search." << std::endl;
+					}
+				}
+			}
+	}
+
+	std::cout << scans << " parallel searches, " << failures << " mismatches." << std::endl;
+	return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,252 @@
+/*
+setop -- apply set operations to several input files and print resulting set to standard output
+Copyright (C) 2015 Frank Stähr, GPL v2 or later
+
+This program is free software:
+you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You can find a copy of the GNU General Public License at <http://www.gnu.org/licenses/>.
+*/
+
+#include "../src/regex_dfa.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/regex.hpp>
+
+
+/**
+\file
+\brief Differential test of RegexDfa against Boost.Regex, run by 'make test'
+\details Every pattern is matched against every input by both engines, the DFA also with input arriving piece by piece.
+	Matches must be the same as those of boost::regex_search repeated behind each match. Patterns are fixed ones
+	(including those handled by specialized scanners) and random ones from a fixed seed, so that runs are reproducible.
+*/
+
+
+/** \brief number of random patterns */
+#define RANDOM_PATTERNS 3000
+/** \brief number of random inputs per pattern (besides the fixed ones) */
+#define RANDOM_INPUTS 20
+/** \brief maximal length of random inputs */
+#define RANDOM_INPUT_LENGTH 60
+/** \brief number of reported mismatches, the test goes on silently afterwards */
+#define REPORTED_FAILURES 20
+
+typedef std::vector<std::pair<std::size_t, std::size_t>> matches_t;
+
+static std::mt19937 random_generator(20151120);
+
+static std::size_t random_below(std::size_t limit)
+{
+	return random_generator() % limit;
+}
+
+static std::string random_alternatives(unsigned depth);
+
+/** \brief Returns random sequence of atoms (characters, classes, groups), each with random quantifier. */
+static std::string random_sequence(unsigned depth)
+{
+	static char const* const atoms[] = { "a", "b", "c", ".", "[ab]", "[^a]", "\\w", "\\d", "[a-b\\s]", "\\n", "\\x2c" };
+	static char const* const quantifiers[] = { "*", "+", "?", "{1,2}", "{2}", "*?", "+?", "{0,2}?" };
+	std::string sequence;
+	for (std::size_t n = 1 + random_below(3); n > 0; --n)
+	{
+		std::size_t const kind = random_below(depth > 2 ? 11 : 14);
+		if (kind < 11)
+			sequence += atoms[kind];
+		else
+			sequence += (kind == 11 ? "(?:" : "(") + random_alternatives(depth + 1) + ")";
+		std::size_t const quantifier = random_below(16);
+		if (quantifier < 8)
+			sequence += quantifiers[quantifier];
+	}
+	return sequence;
+}
+
+/** \brief Returns one or more random sequences separated by |. */
+static std::string random_alternatives(unsigned depth)
+{
+	std::string alternatives = random_sequence(depth);
+	for (std::size_t n = (random_below(3) == 0 ? 1 + random_below(2) : 0); n > 0; --n)
+		alternatives += "|" + random_sequence(depth);
+	return alternatives;
+}
+
+static std::string random_input()
+{
+	static char const characters[] = " abc\n\r,\t1a";
+	std::string input;
+	for (std::size_t n = random_below(RANDOM_INPUT_LENGTH + 1); n > 0; --n)
+		input += characters[random_below(sizeof(characters) - 1)];
+	return input;
+}
+
+/** \brief Returns all matches found by Boost.Regex, searching again behind each match. */
+static matches_t boost_matches(boost::regex const& regex, std::string const& input)
+{
+	matches_t matches;
+	for (boost::sregex_iterator match(input.begin(), input.end(), regex), end; match != end; ++match)
+		matches.emplace_back(match->position(), match->position() + match->length());
+	return matches;
+}
+
+/** \brief Returns all matches found by the DFA in the whole input. */
+static matches_t dfa_matches(RegexDfa& dfa, std::string const& input)
+{
+	matches_t matches;
+	char const* position = input.data();
+	char const* const end = input.data() + input.size();
+	while (true)
+	{
+		RegexDfa::Match const match = dfa.find(position, end, true);
+		if (match.status != RegexDfa::Match::FOUND)
+			break;
+		matches.emplace_back(match.first - input.data(), match.last - input.data());
+		position = match.last;
+	}
+	return matches;
+}
+
+/**
+\brief Returns all matches found by the DFA when input arrives in pieces of random size, like parse_input reads it.
+\details Input before the position returned with MORE is dropped, so the search starts there when more input is available.
+*/
+static matches_t dfa_matches_in_pieces(RegexDfa& dfa, std::string const& input)
+{
+	matches_t matches;
+	char const* position = input.data();
+	std::size_t available = random_below(input.size() + 1);
+	while (true)
+	{
+		bool const at_end = (available == input.size());
+		RegexDfa::Match const match = dfa.find(position, input.data() + available, at_end);
+		if (match.status == RegexDfa::Match::FOUND)
+		{
+			matches.emplace_back(match.first - input.data(), match.last - input.data());
+			position = match.last;
+			continue;
+		}
+		if (at_end)
+			break;
+		position = (match.status == RegexDfa::Match::MORE ? match.last : input.data() + available);
+		available = std::min(input.size(), available + 1 + random_below(6));
+	}
+	return matches;
+}
+
+static void print_matches(char const* engine, matches_t const& matches)
+{
+	std::cout << "\t" << engine << ":";
+	for (auto const& match : matches)
+		std::cout << " " << match.first << "-" << match.second;
+	std::cout << std::endl;
+}
+
+/** \brief Compares engines for pattern on all inputs, returns number of mismatches. */
+static unsigned test_pattern(std::string const& pattern, std::vector<std::string> const& inputs, bool must_be_supported,
+	unsigned& tested)
+{
+	boost::regex regex;
+	try
+	{
+		regex = boost::regex(pattern, boost::regex_constants::ECMAScript | boost::regex_constants::optimize);
+	}
+	catch (boost::regex_error const&)
+	{
+		return 0;
+	}
+	std::unique_ptr<RegexDfa> const dfa = RegexDfa::create(pattern);
+	if (!dfa)
+	{
+		if (!must_be_supported)
+			return 0;
+		std::cout << "Pattern /" << pattern << "/ is not supported by the DFA." << std::endl;
+		return 1;
+	}
+	++tested;
+
+	unsigned failures = 0;
+	for (std::string const& input : inputs)
+	{
+		matches_t expected;
+		try
+		{
+			expected = boost_matches(regex, input);
+		}
+		catch (std::runtime_error const&)
+		{
+			// Boost.Regex gives up on too complex matches
+			continue;
+		}
+		matches_t const whole = dfa_matches(*dfa, input);
+		matches_t const pieces = dfa_matches_in_pieces(*dfa, input);
+		if (whole == expected && pieces == expected)
+			continue;
+		if (++failures <= REPORTED_FAILURES)
+		{
+			std::cout << "Pattern /" << pattern << "/ on input \"" << input << "\":" << std::endl;
+			print_matches("boost", expected);
+			print_matches("dfa", whole);
+			print_matches("dfa in pieces", pieces);
+		}
+	}
+	return failures;
+}
+
+
+int main()
+{
+	// separators and elements as typically given to setop, some of them handled by specialized scanners
+	static char const* const fixed_patterns[] =
+	{
+		"\\n", "\\r?\\n", "\\r\\n", "[[:space:]]+", ",", "\\t", "\\x2c", "[,\\t]", "\\s+?", "\\d+", "\\w+",
+		"a+?", "[ab]", "a?b", "a?a", "b+", "[^a]+", "a{1,}", "\\r\\n|;|, |\\t", "ab|a", "a|ab", "abc|b", "aa|a", "a b|b",
+		"(?:ab|ba)|c", "a\\r1|\\r", "user=\\w+", "ab+c|abd", "(?:ab){2}c.", "a.b", "aa(?:a|b)+", "a\\r\\n.*?1",
+		"(?:ab|ac)*?c", "a+?b", "[^,\\n]+", "\\w+@\\w+\\.\\w+",
+		// a partial match at end of input used to hide the following full match in parse_input, see README
+		"\\w+c|a", "((a|ab)*c?|b)\\d*\\w+"
+	};
+	std::vector<std::string> fixed_inputs = { "", "a", "ba", ".a", "ab", "abc", "a\r\nb\n", "a, b,c\t1", "user=ab c user=" };
+	// all short inputs over a small alphabet
+	std::vector<std::string> inputs = { "" };
+	for (std::size_t begin = 0, end = 1, length = 1; length <= 4; ++length)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			for (char const character : std::string(" abc\n"))
+				inputs.push_back(inputs[i] + character);
+		begin = end;
+		end = inputs.size();
+	}
+	inputs.insert(inputs.end(), fixed_inputs.begin(), fixed_inputs.end());
+	for (std::size_t i = 0; i < RANDOM_INPUTS; ++i)
+		inputs.push_back(random_input());
+
+	unsigned failures = 0;
+	unsigned tested = 0;
+	for (char const* const pattern : fixed_patterns)
+		failures += test_pattern(pattern, inputs, true, tested);
+
+	for (std::size_t i = 0; i < RANDOM_PATTERNS; ++i)
+	{
+		std::string const pattern = random_alternatives(0);
+		std::vector<std::string> random_inputs = fixed_inputs;
+		for (std::size_t j = 0; j < RANDOM_INPUTS; ++j)
+			random_inputs.push_back(random_input());
+		failures += test_pattern(pattern, random_inputs, false, tested);
+	}
+
+	std::cout << tested << " patterns tested, " << failures << " mismatches." << std::endl;
+	return (failures == 0 ? 0 : 1);
+}